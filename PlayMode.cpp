@@ -7,12 +7,16 @@
 #include "Load.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
+#include "import_presets.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
 #include <random>
 #include <map>
 #include <deque>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
 
 
 
@@ -73,24 +77,87 @@ float tri[] = {
 
 unsigned int tri_ele[] = {0, 1, 3, 1, 2, 3};
 
-const char* vertex_shader = "#version 330 core\n"
+//the skinning shader is compiled as several variants: the version line, then a line of defines, then this:
+// INFLUENCES undefined - BoneID / BoneWeight (four ints, -1 for unused, and four floats)
+// INFLUENCES 1, 2, 4 - that many uint8 ids and unorm8 weights (see VertexEncoding in Skeletal.hpp)
+// BAKED_PALETTE - bone matrices are read from a baked palette texture instead of the BoneTransforms uniform
+const char* vertex_shader_version = "#version 330 core\n";
+const char* vertex_shader =
 "layout (location = 0) in vec4 Position;\n"
+"#ifdef INFLUENCES\n"
+"layout (location = 1) in uvec4 BoneIDs;\n"
+"#else\n"
 "layout (location = 1) in ivec4 BoneIDs;\n"
+"#endif\n"
 "layout (location = 2) in vec4 BoneWeights;\n"
 "layout (location = 3) in vec3 pass_Normal;\n"
 "out vec3 Normal;\n"
+"#ifdef BAKED_PALETTE\n"
+//bone matrices from a clip's baked palette texture (see SkeletalAsset::bind_palette): three texels per skeleton bone, one row per frame
+"uniform sampler2D Palette;\n"
+"uniform isampler2D PaletteBones;\n" //every mesh's bone -> skeleton bone map, one after another
+"uniform int PaletteFrame;\n"
+"uniform int PaletteOffsets[16];\n" //each instance's first entry in PaletteBones (meshes sharing geometry are drawn as instances)
+"mat4 bone_matrix(int bone) {\n"
+"	int x = 3 * texelFetch(PaletteBones, ivec2(PaletteOffsets[gl_InstanceID] + bone, 0), 0).r;\n"
+"	vec4 r0 = texelFetch(Palette, ivec2(x + 0, PaletteFrame), 0);\n"
+"	vec4 r1 = texelFetch(Palette, ivec2(x + 1, PaletteFrame), 0);\n"
+"	vec4 r2 = texelFetch(Palette, ivec2(x + 2, PaletteFrame), 0);\n"
+"	return transpose(mat4(r0, r1, r2, vec4(0, 0, 0, 1)));\n"
+"}\n"
+"#else\n"
 "uniform mat4[64] BoneTransforms;\n"
+"mat4 bone_matrix(int bone) { return BoneTransforms[bone]; }\n"
+"#endif\n"
 "uniform mat4 MVP;\n"
+//compact vertex encodings (see VertexEncoding in Skeletal.hpp); all off by default:
+"uniform bool QuantizedPositions;\n"
+"uniform vec3 PositionMin;\n"
+"uniform vec3 PositionExtent;\n"
+"uniform bool OctNormals;\n"
+"vec3 oct_decode(vec2 e) {\n"
+"	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+"	if (v.z < 0.0) v.xy = (1.0 - abs(v.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(v.xy, vec2(0.0)));\n"
+"	return normalize(v);\n"
+"}\n"
 "void main() {\n"
+"	vec4 position = Position;\n"
+"	if (QuantizedPositions) position = vec4(PositionMin + Position.xyz * PositionExtent, 1.0);\n"
+"#if !defined(INFLUENCES)\n"
 "	vec4 transformed = vec4(0, 0, 0, 1);\n"
 "	for (int i = 0; i < 4; i++) {\n"
 "		int index = BoneIDs[i];\n"
-"		if (index != -1) transformed = transformed + BoneWeights[i] * BoneTransforms[index] * Position;\n"
+"		if (index != -1) transformed = transformed + BoneWeights[i] * bone_matrix(index) * position;\n"
 "	}\n"
-	"Normal = pass_Normal;\n"
+"#elif INFLUENCES == 1\n"
+"	vec4 transformed = bone_matrix(int(BoneIDs.x)) * position;\n"
+"#else\n"
+"	vec4 transformed = vec4(0);\n"
+"	for (int i = 0; i < INFLUENCES; i++) {\n"
+"		transformed += BoneWeights[i] * bone_matrix(int(BoneIDs[i])) * position;\n"
+"	}\n"
+"#endif\n"
+	"Normal = (OctNormals ? oct_decode(pass_Normal.xy) : pass_Normal);\n"
 "	gl_Position = MVP * transformed;\n"
 "}\n";
 
+//vertex animation: clips skinned ahead of time, one texel per vertex per frame (see SkeletalAsset::bind_vertex_animation);
+// vertices are found by gl_VertexID, so no attributes or bones are needed at all
+const char* vertex_shader_vat = "#version 330 core\n"
+"out vec3 Normal;\n"
+"uniform sampler2D AnimatedPositions;\n"
+"uniform sampler2D AnimatedNormals;\n"
+"uniform int AnimationWidth;\n"
+"uniform int AnimationFirstRow;\n"
+"uniform int AnimationOffset;\n"
+"uniform mat4 MVP;\n"
+"void main() {\n"
+"	int v = AnimationOffset + gl_VertexID;\n"
+"	ivec2 texel = ivec2(v % AnimationWidth, AnimationFirstRow + v / AnimationWidth);\n"
+"	Normal = texelFetch(AnimatedNormals, texel, 0).xyz;\n"
+"	gl_Position = MVP * vec4(texelFetch(AnimatedPositions, texel, 0).xyz, 1.0);\n"
+"}\n";
+
 const char* vertex_shader_pos = "#version 330 core\n"
 "layout (location = 0) in vec4 Position;\n"
 "uniform mat4 MVP;\n"
@@ -282,47 +349,90 @@ void AnimatedMesh::update_bones_rec(const aiNode* node, const glm::mat4& parent_
 
 PlayMode::PlayMode() {
 
-	
-    scene = importer.ReadFile(data_path("bastionik.dae"),
-        aiProcess_CalcTangentSpace       |
-        aiProcess_Triangulate            |
-        aiProcess_JoinIdenticalVertices  |
-        aiProcess_SortByPType);
-
-    if (scene == nullptr) {
-        std::cerr << "Could not load asset.\n";
-		return;
-    }
-    
-	std::function<void(const aiNode*)> visit_node;
-	visit_node = [&](const aiNode* node) {
-		std::cout << node->mName.data << ", " << node->mNumMeshes << std::endl;
-		for (unsigned int child_idx = 0; child_idx < node->mNumChildren; child_idx++) {
-			visit_node(node->mChildren[child_idx]);
+	num_animation_frames = 180;
+
+	if (std::ifstream(data_path("skeletal.skel"))) {
+		// exported asset: no Assimp needed
+		skeletal_asset.reset(new SkeletalAsset(data_path("skeletal.skel")));
+		skeletal_asset->upload();
+		current_clip = 0;
+		clip_time = 0.0f;
+		if (!skeletal_asset->clips.empty()) {
+			skeletal_asset->update_nodes(current_clip, 0.0f);
 		}
-	};
+		glEnable(GL_DEPTH_TEST);
+	} else {
+		scene = importer.ReadFile(data_path("bastionik.dae"), ImportSkinnedMinimal);
 
-	visit_node(scene->mRootNode);
+		if (scene == nullptr) {
+			std::cerr << "Could not load asset.\n";
+			return;
+		}
 
-	
-	for (unsigned m = 0; m < scene->mNumMeshes; m++) {
-		animated_meshes.emplace_back(scene->mMeshes[m], scene);
-	}
-	// animated_meshes.emplace_back(scene->mMeshes[0], scene);
+		std::function<void(const aiNode*)> visit_node;
+		visit_node = [&](const aiNode* node) {
+			std::cout << node->mName.data << ", " << node->mNumMeshes << std::endl;
+			for (unsigned int child_idx = 0; child_idx < node->mNumChildren; child_idx++) {
+				visit_node(node->mChildren[child_idx]);
+			}
+		};
+
+		visit_node(scene->mRootNode);
 
+		for (unsigned m = 0; m < scene->mNumMeshes; m++) {
+			animated_meshes.emplace_back(scene->mMeshes[m], scene);
+		}
+		// animated_meshes.emplace_back(scene->mMeshes[0], scene);
+	}
 
-	vshader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vshader, 1, &vertex_shader, NULL);
-	glCompileShader(vshader);
 
 	fshader = glCreateShader(GL_FRAGMENT_SHADER);
 	glShaderSource(fshader, 1, &fragment_shader, NULL);
 	glCompileShader(fshader);
 
-	program = glCreateProgram();
-	glAttachShader(program, vshader);
-	glAttachShader(program, fshader);
-	glLinkProgram(program);
+	auto make_skinning_program = [&](const char* defines, unsigned int* vshader_) {
+		const char* sources[] = {vertex_shader_version, defines, vertex_shader};
+		*vshader_ = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(*vshader_, 3, sources, NULL);
+		glCompileShader(*vshader_);
+
+		unsigned int ret = glCreateProgram();
+		glAttachShader(ret, *vshader_);
+		glAttachShader(ret, fshader);
+		glLinkProgram(ret);
+		return ret;
+	};
+	program = make_skinning_program("\n", &vshader);
+	if (skeletal_asset) {
+		for (auto const& mesh : skeletal_asset->meshes) {
+			if (mesh.influences == 0 || influence_programs[mesh.influences] != 0) continue;
+			std::string defines = "#define INFLUENCES " + std::to_string(mesh.influences) + "\n";
+			unsigned int influence_vshader;
+			influence_programs[mesh.influences] = make_skinning_program(defines.c_str(), &influence_vshader);
+		}
+		bool any_palette = false;
+		bool any_vertex_animation = false;
+		for (auto c = 0u; c < skeletal_asset->clips.size(); c++) {
+			any_palette = any_palette || skeletal_asset->has_palette(c);
+			any_vertex_animation = any_vertex_animation || skeletal_asset->has_vertex_animation(c);
+		}
+		if (any_vertex_animation) {
+			vat_vshader = glCreateShader(GL_VERTEX_SHADER);
+			glShaderSource(vat_vshader, 1, &vertex_shader_vat, NULL);
+			glCompileShader(vat_vshader);
+			vat_program = glCreateProgram();
+			glAttachShader(vat_program, vat_vshader);
+			glAttachShader(vat_program, fshader);
+			glLinkProgram(vat_program);
+		}
+		for (auto const& mesh : skeletal_asset->meshes) {
+			if (!any_palette || baked_programs[mesh.influences] != 0) continue;
+			std::string defines = "#define BAKED_PALETTE\n";
+			if (mesh.influences) defines += "#define INFLUENCES " + std::to_string(mesh.influences) + "\n";
+			unsigned int baked_vshader;
+			baked_programs[mesh.influences] = make_skinning_program(defines.c_str(), &baked_vshader);
+		}
+	}
 
 	
 	glm::mat4 proj = glm::perspective(glm::radians(45.0f), (float)1280/(float)720, 0.1f, 100.0f);
@@ -334,13 +444,17 @@ PlayMode::PlayMode() {
   		   glm::vec3(0.0f, 0, -1.0f));
 
 	glm::mat4 mvp = proj * view;
+	world_to_clip = mvp;
 	
-	glUseProgram(program);
-	unsigned int mvp_id = glGetUniformLocation(program, "MVP");
-	glUniformMatrix4fv(mvp_id, 1, GL_FALSE, (const float*)&mvp);
+	for (unsigned int p : {program, influence_programs[1], influence_programs[2], influence_programs[4],
+			baked_programs[0], baked_programs[1], baked_programs[2], baked_programs[4], vat_program}) {
+		if (p == 0) continue;
+		glUseProgram(p);
+		unsigned int mvp_id = glGetUniformLocation(p, "MVP");
+		glUniformMatrix4fv(mvp_id, 1, GL_FALSE, (const float*)&mvp);
+	}
 	glUseProgram(0);
 
-	num_animation_frames = 180;
 	current_animation_frame = 0;
 }
 
@@ -353,6 +467,7 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 }
 
 void PlayMode::update(float elapsed) {
+	clip_time += elapsed;
 	elapsed_time += elapsed;
 	if (elapsed_time >= 0.033f) {
 		elapsed_time = 0;
@@ -372,8 +487,68 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 			animated_mesh.update_bones(current_animation_frame);
 		}
 	}
+	if (skeletal_asset && !skeletal_asset->clips.empty()) {
+		// exported clips play in real time (keys are at a uniform rate, so any time maps straight to a frame)
+		if (clip_time > skeletal_asset->clip_length(current_clip)) {
+			// move on to the next clip
+			clip_time = 0.0f;
+			current_clip = (current_clip + 1) % skeletal_asset->clips.size();
+		}
+		if (!skeletal_asset->has_palette(current_clip) && !skeletal_asset->has_vertex_animation(current_clip)) {
+			skeletal_asset->update_nodes(current_clip, skeletal_asset->frame_at(current_clip, clip_time));
+		}
+	}
 
 	for (auto& animated_mesh : animated_meshes) {
 		animated_mesh.draw(program);
 	}
+	if (skeletal_asset) {
+		bool baked = (!skeletal_asset->clips.empty() && skeletal_asset->has_palette(current_clip));
+		bool vertex_animated = (!skeletal_asset->clips.empty() && skeletal_asset->has_vertex_animation(current_clip));
+		skeleton_transforms.clear();
+		for (auto m = 0u; m < skeletal_asset->meshes.size(); m++) {
+			uint32_t influences = skeletal_asset->meshes[m].influences;
+			// the character stands at the origin: pick the cheapest LOD that stays within a pixel of the full mesh
+			float pixels_per_unit = float(drawable_size.y) / (2.0f * std::tan(glm::radians(45.0f) * 0.5f));
+			unsigned int lod = skeletal_asset->select_lod(m, glm::length(eye), pixels_per_unit);
+			if (vertex_animated) {
+				// pre-skinned clip: the cheapest draw there is, no bones on the CPU or the GPU
+				unsigned int frame = unsigned(skeletal_asset->frame_at(current_clip, clip_time) + 0.5f);
+				skeletal_asset->bind_vertex_animation(m, vat_program, current_clip, frame);
+				skeletal_asset->draw(m, vat_program, std::vector< glm::mat4 >(), nullptr, lod);
+				continue;
+			}
+			if (baked) {
+				// baked clip: no pose on the CPU at all, just the nearest frame of the palette
+				// (so no meshlet culling either, which needs the bone transforms)
+				// meshes that reuse this one's geometry are drawn with it, as instances
+				if (skeletal_asset->meshes[m].geometry_source >= 0) continue;
+				std::vector< unsigned int > same_geometry{m};
+				for (auto other = m + 1; other < skeletal_asset->meshes.size(); other++) {
+					if (skeletal_asset->meshes[other].geometry_source == int32_t(m)) same_geometry.emplace_back(other);
+				}
+				unsigned int frame = unsigned(skeletal_asset->frame_at(current_clip, clip_time) + 0.5f);
+				for (size_t first = 0; first < same_geometry.size(); first += SkeletalAsset::MaxPaletteInstances) {
+					size_t count = std::min(same_geometry.size() - first, size_t(SkeletalAsset::MaxPaletteInstances));
+					std::vector< unsigned int > instances(same_geometry.begin() + first, same_geometry.begin() + first + count);
+					skeletal_asset->bind_palette(instances, baked_programs[influences], current_clip, frame);
+					skeletal_asset->draw(m, baked_programs[influences], std::vector< glm::mat4 >(), nullptr, lod, GLsizei(count));
+				}
+				continue;
+			}
+			if (skeleton_transforms.empty()) {
+				// bones shared by several meshes are computed once per frame
+				skeletal_asset->get_skeleton_transforms(&skeleton_transforms);
+			}
+			skeletal_asset->get_bone_transforms(m, skeleton_transforms, &skeletal_bone_transforms);
+			GLuint mesh_program = (influences ? influence_programs[influences] : program);
+			if (lod == 0 && !skeletal_asset->meshes[m].meshlets.empty()) {
+				// skip meshlets that are off-screen or facing away
+				skeletal_asset->cull_meshlets(m, skeletal_bone_transforms, world_to_clip, eye, true, &visible_meshlets);
+				skeletal_asset->draw(m, mesh_program, skeletal_bone_transforms, &visible_meshlets);
+			} else {
+				skeletal_asset->draw(m, mesh_program, skeletal_bone_transforms, nullptr, lod);
+			}
+		}
+	}
 }
@@ -1,6 +1,8 @@
 #include "Mode.hpp"
 
 #include "Scene.hpp"
+#include "Skeletal.hpp"
+#include "SkeletalAsset.hpp"
 
 #include <glm/glm.hpp>
 
@@ -12,47 +14,7 @@
 #include <assimp/postprocess.h>
 
 #include <map>
-
-struct BoneWeight {
-	float weights[4];
-
-	BoneWeight() {
-		weights[0] = 0.0f;
-		weights[1] = 0.0f;
-		weights[2] = 0.0f;
-		weights[3] = 0.0f;
-	}
-
-	void insert(float weight) {
-		for (int i = 0; i < 4; i++) {
-			if (weights[i] == 0.0f) {
-				weights[i] = weight;
-				break;
-			}
-		}
-	}
-};
-
-
-struct BoneID {
-	int ids[4];
-
-	BoneID() {
-		ids[0] = -1;
-		ids[1] = -1;
-		ids[2] = -1;
-		ids[3] = -1;
-	}
-
-	void insert(int id) {
-		for (int i = 0; i < 4; i++) {
-			if (ids[i] == -1) {
-				ids[i] = id;
-				break;
-			}
-		}
-	}
-};
+#include <memory>
 
 struct AnimatedMesh {
 	// all the rendering garbage
@@ -91,6 +53,9 @@ struct PlayMode : Mode {
 
 	//----- game state -----
 	unsigned int vshader, fshader, program;
+	unsigned int influence_programs[5] = {0, 0, 0, 0, 0}; //skinning shader variants for compact bone influences, by count (1, 2, 4)
+	unsigned int baked_programs[5] = {0, 0, 0, 0, 0}; //BAKED_PALETTE variants of the above, by count (0 for BoneID + BoneWeight)
+	unsigned int vat_vshader = 0, vat_program = 0; //draws clips exported with vertex animation textures
 	unsigned int line_vshader, line_fshader, line_program, line_vbo, line_vao, line_ebo;
 	Assimp::Importer importer;
 	const aiScene* scene;
@@ -100,6 +65,15 @@ struct PlayMode : Mode {
 
 	std::vector<AnimatedMesh> animated_meshes;
 
+	// exporter output; used instead of the Assimp scene when dist/skeletal.skel exists
+	std::unique_ptr<SkeletalAsset> skeletal_asset;
+	unsigned int current_clip = 0; // clips play one after another, all from the one loaded asset
+	float clip_time = 0.0f; // seconds into current_clip
+	std::vector<glm::mat4> skeleton_transforms; //the whole skeleton's, computed once per frame
+	std::vector<glm::mat4> skeletal_bone_transforms;
+	std::vector<uint32_t> visible_meshlets;
+	glm::mat4 world_to_clip; // the MVP the skinning shaders were set up with, for meshlet culling
+
 	glm::vec3 focus;
 	glm::vec3 eye;
 
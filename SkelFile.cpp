@@ -0,0 +1,159 @@
+#include "SkelFile.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+namespace {
+	struct SkelHeader {
+		char magic[4] = {'s', 'k', 'e', 'l'};
+		uint32_t version = 1;
+		uint32_t count = 0;
+		uint32_t reserved = 0;
+	};
+	static_assert(sizeof(SkelHeader) == 16, "SkelHeader is packed");
+
+	//table of contents order:
+	bool entry_less(SkelEntry const &a, std::string const &magic, uint32_t index) {
+		int cmp = std::memcmp(a.magic, magic.data(), 4);
+		if (cmp != 0) return cmp < 0;
+		return a.index < index;
+	}
+}
+
+void SkelWriter::write(std::ostream *to_) const {
+	assert(to_);
+	auto &to = *to_;
+
+	std::vector< SkelEntry > entries;
+	entries.reserve(chunks.size());
+	for (auto const &chunk : chunks) {
+		entries.emplace_back(chunk.entry);
+	}
+
+	//chunk data is laid out in the order chunks were added; the table of contents is sorted for lookup:
+	uint32_t offset = uint32_t(sizeof(SkelHeader) + sizeof(SkelEntry) * entries.size());
+	for (auto &entry : entries) {
+		offset = (offset + entry.alignment - 1) / entry.alignment * entry.alignment;
+		entry.offset = offset;
+		offset += entry.size;
+	}
+	uint32_t total = offset;
+
+	std::sort(entries.begin(), entries.end(), [](SkelEntry const &a, SkelEntry const &b) {
+		return entry_less(a, std::string(b.magic, 4), b.index);
+	});
+	for (uint32_t i = 1; i < entries.size(); ++i) {
+		if (std::memcmp(entries[i-1].magic, entries[i].magic, 4) == 0 && entries[i-1].index == entries[i].index) {
+			throw std::runtime_error("Duplicate chunk '" + std::string(entries[i].magic, 4) + "' index " + std::to_string(entries[i].index));
+		}
+	}
+
+	std::vector< char > out(total, '\0');
+
+	SkelHeader header;
+	header.count = uint32_t(entries.size());
+	std::memcpy(out.data(), &header, sizeof(header));
+	if (!entries.empty()) {
+		std::memcpy(out.data() + sizeof(header), entries.data(), sizeof(SkelEntry) * entries.size());
+	}
+
+	for (auto const &chunk : chunks) {
+		auto f = std::lower_bound(entries.begin(), entries.end(), chunk.entry, [](SkelEntry const &a, SkelEntry const &b) {
+			return entry_less(a, std::string(b.magic, 4), b.index);
+		});
+		assert(f != entries.end());
+		if (!chunk.data.empty()) {
+			std::memcpy(out.data() + f->offset, chunk.data.data(), chunk.data.size());
+		}
+	}
+
+	to.write(out.data(), out.size());
+}
+
+SkelFile::SkelFile(std::string const &filename_, bool toc_only_) : filename(filename_), toc_only(toc_only_) {
+	file.open(filename, std::ios::binary | std::ios::ate);
+	if (!file) {
+		throw std::runtime_error("Failed to open '" + filename + "'");
+	}
+
+	//one read for the whole file (or, when streaming, for the header and then the table of contents):
+	std::streamsize size = file.tellg();
+	file.seekg(0, std::ios::beg);
+	data.resize(toc_only ? std::min(size_t(size), sizeof(SkelHeader)) : size_t(size));
+	if (!data.empty() && !file.read(data.data(), std::streamsize(data.size()))) {
+		throw std::runtime_error("Failed to read '" + filename + "'");
+	}
+
+	SkelHeader header;
+	if (data.size() < sizeof(header)) {
+		throw std::runtime_error("File '" + filename + "' is too small to be a .skel file");
+	}
+	std::memcpy(&header, data.data(), sizeof(header));
+	if (std::string(header.magic, 4) != "skel") {
+		throw std::runtime_error("Unexpected magic number in '" + filename + "'");
+	}
+	if (header.version != SkelHeader().version) {
+		throw std::runtime_error("Unsupported .skel version " + std::to_string(header.version) + " in '" + filename + "'");
+	}
+	if (size_t(size) < sizeof(header) + sizeof(SkelEntry) * size_t(header.count)) {
+		throw std::runtime_error("Table of contents of '" + filename + "' runs past end of file");
+	}
+
+	entries.resize(header.count);
+	if (!entries.empty()) {
+		if (toc_only) {
+			if (!file.read(reinterpret_cast< char * >(entries.data()), std::streamsize(sizeof(SkelEntry) * entries.size()))) {
+				throw std::runtime_error("Failed to read table of contents of '" + filename + "'");
+			}
+		} else {
+			std::memcpy(entries.data(), data.data() + sizeof(header), sizeof(SkelEntry) * entries.size());
+		}
+	}
+	if (toc_only) data.clear();
+	else file.close(); //everything is in 'data' already
+
+	for (auto const &entry : entries) {
+		if (!(size_t(entry.offset) + size_t(entry.size) <= size_t(size))) {
+			throw std::runtime_error("Chunk '" + std::string(entry.magic, 4) + "' of '" + filename + "' runs past end of file");
+		}
+		if (entry.alignment == 0 || entry.alignment > SkelMaxAlignment || entry.offset % entry.alignment != 0) {
+			throw std::runtime_error("Chunk '" + std::string(entry.magic, 4) + "' of '" + filename + "' is misaligned");
+		}
+	}
+}
+
+void SkelFile::read_from_disk(SkelEntry const &entry, void *to) const {
+	if (entry.size == 0) return;
+	std::lock_guard< std::mutex > lock(file_mutex);
+	file.clear(); //a failed earlier read shouldn't poison this one
+	file.seekg(std::streamoff(entry.offset), std::ios::beg);
+	if (!file || !file.read(reinterpret_cast< char * >(to), std::streamsize(entry.size))) {
+		throw std::runtime_error("Failed to read chunk '" + std::string(entry.magic, 4) + "' of '" + filename + "'");
+	}
+}
+
+SkelEntry const *SkelFile::find(std::string const &magic, uint32_t index) const {
+	assert(magic.size() == 4);
+	auto f = std::lower_bound(entries.begin(), entries.end(), index, [&magic](SkelEntry const &a, uint32_t i) {
+		return entry_less(a, magic, i);
+	});
+	if (f == entries.end() || std::memcmp(f->magic, magic.data(), 4) != 0 || f->index != index) return nullptr;
+	return &*f;
+}
+
+SkelEntry const &SkelFile::lookup(std::string const &magic, uint32_t index) const {
+	SkelEntry const *entry = find(magic, index);
+	if (!entry) {
+		throw std::runtime_error("Missing chunk '" + magic + "' index " + std::to_string(index));
+	}
+	return *entry;
+}
+
+uint32_t SkelFile::count(std::string const &magic) const {
+	assert(magic.size() == 4);
+	uint32_t ret = 0;
+	for (auto const &entry : entries) {
+		if (std::memcmp(entry.magic, magic.data(), 4) == 0) ++ret;
+	}
+	return ret;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+/*
+ * A ".skel" file packs all of the chunks produced by the exporter into a
+ *  single file with a table of contents up front:
+ *
+ * |sk|el|..| <-- four byte "magic number"
+ * |ve|rs|io|n.| <-- four byte format version
+ * |co|un|t.|..| <-- four byte number of table of contents entries
+ * |re|se|rv|ed| <-- four bytes of padding
+ * |Entry| * count <-- table of contents, sorted by (magic, index)
+ * |...payload...| <-- chunk data, each chunk starting at a multiple of its alignment
+ *
+ * Chunks are named by a four byte magic number plus an index (e.g. "vert" + mesh index),
+ *  so a loader can find any mesh or clip after a single open + read of the file.
+ *
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdexcept>
+#include <cassert>
+#include <fstream>
+#include <mutex>
+
+struct SkelEntry {
+	char magic[4] = {'\0', '\0', '\0', '\0'};
+	uint32_t index = 0; //which mesh / clip / etc this chunk belongs to
+	uint32_t offset = 0; //byte offset of chunk data from start of file
+	uint32_t size = 0; //byte size of chunk data
+	uint32_t alignment = 1; //offset is a multiple of this
+	uint32_t reserved = 0;
+};
+static_assert(sizeof(SkelEntry) == 24, "SkelEntry is packed");
+
+//chunk data lives in a std::vector< char >, so it can only be aligned as well as operator new aligns:
+constexpr uint32_t SkelMaxAlignment = 16;
+
+//SkelWriter accumulates chunks in memory and writes the whole file at once:
+struct SkelWriter {
+	template< typename T >
+	void add(std::string const &magic, uint32_t index, std::vector< T > const &from, uint32_t alignment = alignof(T)) {
+		assert(magic.size() == 4);
+		assert(alignment != 0 && (alignment & (alignment - 1)) == 0 && alignment <= SkelMaxAlignment);
+		chunks.emplace_back();
+		Chunk &chunk = chunks.back();
+		std::memcpy(chunk.entry.magic, magic.data(), 4);
+		chunk.entry.index = index;
+		chunk.entry.size = uint32_t(from.size() * sizeof(T));
+		chunk.entry.alignment = alignment;
+		chunk.data.resize(chunk.entry.size);
+		if (chunk.entry.size) std::memcpy(chunk.data.data(), from.data(), chunk.entry.size);
+	}
+
+	//lay out table of contents + chunk data and write it with a single call:
+	// note: will throw if two chunks share the same magic + index.
+	void write(std::ostream *to) const;
+
+	struct Chunk {
+		SkelEntry entry;
+		std::vector< char > data;
+	};
+	std::vector< Chunk > chunks;
+};
+
+//SkelFile reads a whole .skel file into memory and hands out chunks by magic + index:
+struct SkelFile {
+	//construct from a file:
+	// if 'toc_only', only the header + table of contents are read up front and the file is kept open
+	// so read() can fetch each chunk from disk when asked (for streaming; view() needs the whole file, so it throws).
+	// note: will throw if file fails to read or is malformed.
+	SkelFile(std::string const &filename, bool toc_only = false);
+
+	//look up a chunk; returns nullptr if no such chunk exists:
+	SkelEntry const *find(std::string const &magic, uint32_t index = 0) const;
+
+	//number of chunks with a given magic (e.g. count("vert") is the number of meshes):
+	uint32_t count(std::string const &magic) const;
+
+	//pointer to chunk data, reinterpreted as an array of T (no copy):
+	// note: will throw if chunk is missing or its size is not divisible by sizeof(T).
+	template< typename T >
+	T const *view(std::string const &magic, uint32_t index, size_t *count_) const {
+		if (toc_only) {
+			throw std::runtime_error("Can't view chunk '" + magic + "' of a file opened for streaming");
+		}
+		SkelEntry const &entry = lookup(magic, index);
+		if (entry.size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk '" + magic + "' not divisible by element size");
+		}
+		if (entry.alignment < alignof(T)) {
+			throw std::runtime_error("Chunk '" + magic + "' is not aligned for its element type");
+		}
+		if (count_) *count_ = entry.size / sizeof(T);
+		return reinterpret_cast< T const * >(data.data() + entry.offset);
+	}
+
+	//copy of chunk data as a vector of T:
+	template< typename T >
+	std::vector< T > read(std::string const &magic, uint32_t index = 0) const {
+		if (toc_only) {
+			SkelEntry const &entry = lookup(magic, index);
+			if (entry.size % sizeof(T) != 0) {
+				throw std::runtime_error("Size of chunk '" + magic + "' not divisible by element size");
+			}
+			std::vector< char > bytes(entry.size); //aligned like 'data', see SkelMaxAlignment
+			read_from_disk(entry, bytes.data());
+			T const *begin = reinterpret_cast< T const * >(bytes.data());
+			return std::vector< T >(begin, begin + entry.size / sizeof(T));
+		}
+		size_t count_ = 0;
+		T const *begin = view< T >(magic, index, &count_);
+		return std::vector< T >(begin, begin + count_);
+	}
+
+	//-- internals ---
+	SkelEntry const &lookup(std::string const &magic, uint32_t index) const;
+
+	//read one chunk's bytes straight from the file (toc_only files):
+	void read_from_disk(SkelEntry const &entry, void *to) const;
+
+	std::vector< char > data; //entire file contents (empty if toc_only)
+	std::vector< SkelEntry > entries; //copy of table of contents
+	std::string filename;
+	bool toc_only = false;
+
+	//toc_only files keep one stream open for every streamed read (seek + read, no re-open):
+	mutable std::ifstream file;
+	mutable std::mutex file_mutex; //read() is const, so guard the shared read position
+};
@@ -1,12 +1,20 @@
+#pragma once
+
 #include "data_path.hpp"
 #include "read_write_chunk.hpp"
+#include "quantize.hpp"
+#include "GL.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include <iostream>
 #include <deque>
 #include <vector>
 #include <fstream>
+#include <unordered_map>
+#include <cstddef>
+#include <cstring>
 
 struct BoneWeight {
 	float weights[4];
@@ -55,19 +63,253 @@ struct Bone {
     Bone(int n, const glm::mat4& i) : node_id(n), inverse_binding(i) {}
 };
 
+// one skeleton for a whole character ("skbn" chunk): every distinct bone (node + inverse binding) of all its meshes,
+//  once, with each mesh's bones mapped into it ("bmap" chunk per mesh). Bones shared by several meshes are then
+//  computed once per frame, and each mesh just picks its bones out of the skeleton's transforms.
+struct SkeletonBuilder {
+    std::vector<Bone> bones;
+    std::unordered_multimap<int, uint32_t> by_node;
+
+    // skeleton index of 'bone', added if the skeleton doesn't have it yet
+    uint32_t add(const Bone& bone) {
+        auto range = by_node.equal_range(bone.node_id);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (std::memcmp(&bones[it->second].inverse_binding, &bone.inverse_binding, sizeof(glm::mat4)) == 0) return it->second;
+        }
+        by_node.emplace(bone.node_id, uint32_t(bones.size()));
+        bones.push_back(bone);
+        return uint32_t(bones.size() - 1);
+    }
+};
+
+// the exporter's working copy of a node (written as the dense arrays below), and the "node" chunk of older files
 struct Node {
-    bool has_animation = false;
-    int animation_id = 0;
+    bool has_animation = false; // animated by the first clip...
+    int animation_id = 0; // ...by this channel (other clips map channels to nodes through Animation::node_id)
     int parent_id;
     glm::mat4 transform;
     glm::mat4 overall_transform;
     Node(unsigned int p, const glm::mat4& t) : parent_id(p), transform(t) {}
 };
 
-// ik it's wasteful. Whatever.
-constexpr int NUM_MAX_FRAMES = 180;
+// the hierarchy is stored as dense arrays, one entry per node in parent-before-child order, so posing is one linear pass:
+//  "npar" - int32 parent index (-1 for the root)
+//  "nbnd" - NodeBind: local bind transform, used whenever the node isn't animated
+//  "nchn" - int32 channel animating the node in the first clip (-1 if none; other clips map channels through Animation::node_id)
+//  (files from before these have one "node" chunk of Node, which also stores the runtime's overall_transform scratch)
+struct NodeBind {
+    glm::quat rotation;
+    glm::vec3 translation;
+    glm::vec3 scale;
+};
+static_assert(sizeof(NodeBind) == 40, "NodeBind is packed");
+
+// translate * rotate * scale, built directly
+inline glm::mat4 trs_to_mat4(const glm::quat& rotation, const glm::vec3& translation, const glm::vec3& scale) {
+    glm::mat4 ret = glm::mat4_cast(rotation);
+    ret[0] *= scale.x;
+    ret[1] *= scale.y;
+    ret[2] *= scale.z;
+    ret[3] = glm::vec4(translation, 1.0f);
+    return ret;
+}
+
+// a node the game attaches things to ("sock" chunk, one entry per exporter -socket option), looked up by name;
+//  sockets are always kept when the hierarchy is pruned
+struct Socket {
+    char name[60]; // nul-terminated, truncated if longer
+    int32_t node_id;
+};
+static_assert(sizeof(Socket) == 64, "Socket is packed");
+
+// one animated node in one clip; its keys live in the clip's shared pool so each channel stores exactly as many as it has
 struct Animation {
     int node_id;
-    int num_frames;
-    glm::mat4 keys[NUM_MAX_FRAMES];
-};
\ No newline at end of file
+    int num_frames; // length of the channel in frames
+    int first_key; // index of this channel's first key in its clip's key pool
+    int num_keys; // keys actually stored; less than num_frames once keys have been reduced
+    int first_scale = -1; // TRS layout only: index of first key in the clip's scale pool, -1 if scale is always 1
+};
+
+// one animation take ("clip" chunk, one entry per clip):
+//  its channels are a range of the "anim" chunk, and its key pools ("keys" / "trsk" / "qrot" / ...) are
+//  chunks indexed by clip, so each clip can be loaded (or streamed in) on its own
+struct Clip {
+    char name[40]; // nul-terminated, truncated if longer
+    float duration; // in ticks
+    float ticks_per_second; // duration / ticks_per_second is the clip's length in seconds
+    float sample_rate; // frames per second: channels are resampled so frame f is at f / sample_rate seconds
+    uint32_t first_channel; // channels [first_channel, first_channel + channel_count) of the "anim" chunk
+    uint32_t channel_count;
+    int32_t num_frames; // frames covering the whole clip (every channel has this many, before key reduction)
+};
+static_assert(sizeof(Clip) == 64, "Clip is packed");
+
+// one baked bone matrix ("pall" chunk, see SkeletalAsset::bind_palette): a GLSL mat4x3 (the bottom row of a bone
+//  matrix is always 0,0,0,1) stored as its three rows, so each bone is three RGBA32F texels of a palette texture
+struct PaletteMatrix {
+    glm::vec4 rows[3];
+};
+static_assert(sizeof(PaletteMatrix) == 48, "PaletteMatrix is packed");
+
+inline PaletteMatrix to_palette_matrix(glm::mat4 const &m) {
+    PaletteMatrix ret;
+    for (int r = 0; r < 3; r++) {
+        ret.rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+    }
+    return ret;
+}
+
+inline glm::mat4 from_palette_matrix(PaletteMatrix const &p) {
+    glm::mat4 ret(1.f);
+    for (int c = 0; c < 4; c++) {
+        ret[c] = glm::vec4(p.rows[0][c], p.rows[1][c], p.rows[2][c], c == 3 ? 1.f : 0.f);
+    }
+    return ret;
+}
+
+// a clip's vertex animation texture ("vati" chunk; texels in "vatp" for positions and "vatn" for normals, all indexed by clip):
+//  every mesh's vertices skinned on the CPU at every frame. Each frame is rows_per_frame rows of 'width' texels holding
+//  mesh 0's vertices, then mesh 1's, ... in exported order, so a shader finds its vertex by gl_VertexID.
+//  Texels are RGBA of 'type': position xyz + 1, normal xyz + 0 (rows are padded to 'width' with zeros).
+struct VertexAnimationInfo {
+    uint32_t type; // GL_FLOAT or GL_HALF_FLOAT
+    uint32_t vertex_count; // vertices of all meshes, i.e. texels used per frame
+    uint32_t width; // one row per frame unless there are more vertices than this
+    uint32_t rows_per_frame;
+};
+static_assert(sizeof(VertexAnimationInfo) == 16, "VertexAnimationInfo is packed");
+
+// rotation + translation key, interpolated at runtime and turned into a matrix only for the final pose
+// (scale lives in a separate pool since most channels never scale)
+struct TRSKey {
+    glm::quat rotation;
+    glm::vec3 translation;
+};
+static_assert(sizeof(TRSKey) == 28, "TRSKey is packed");
+
+// quantized layout: rotations are PackedQuat (see quantize.hpp), translation and scale are
+// 16 bits per component relative to the channel's range
+struct QuantizedVec3 {
+    uint16_t v[3];
+};
+static_assert(sizeof(QuantizedVec3) == 6, "QuantizedVec3 is packed");
+
+struct QuantizedRange {
+    glm::vec3 translation_min;
+    glm::vec3 translation_extent;
+    glm::vec3 scale_min;
+    glm::vec3 scale_extent;
+};
+
+// one attribute of an interleaved vertex stream, in the form glVertexAttribPointer / glVertexAttribIPointer want it
+struct VertexAttribute {
+    uint32_t location; // attribute location in the skinning shader
+    uint32_t size; // number of components
+    uint32_t type; // GL_FLOAT, GL_INT, ...
+    uint32_t normalized; // GL_TRUE to map integer data to [0,1] / [-1,1]
+    uint32_t integer; // nonzero if the shader reads the attribute as integers
+    uint32_t stride;
+    uint32_t offset;
+};
+static_assert(sizeof(VertexAttribute) == 28, "VertexAttribute is packed");
+
+// attribute locations of the skinning shader
+enum SkinningAttributeLocation : uint32_t {
+    SkinPosition = 0,
+    SkinBoneIDs = 1,
+    SkinBoneWeights = 2,
+    SkinNormal = 3,
+};
+
+// the full-precision interleaved vertex the skinning shader consumes
+struct SkinnedVertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    BoneID bone_ids;
+    BoneWeight bone_weights;
+};
+static_assert(sizeof(SkinnedVertex) == 56, "SkinnedVertex is packed");
+
+// optional compact encodings of the interleaved stream
+struct VertexEncoding {
+    bool quantized_positions = false; // unorm16x3 relative to the mesh bounds (see VertexQuantization), instead of float3
+    bool oct_normals = false; // octahedral snorm16x2 (see pack_normal in quantize.hpp), instead of float3
+    uint32_t influences = 0; // 1, 2 or 4: that many uint8 bone ids + unorm8 weights (summing to 255), instead of BoneID + BoneWeight
+};
+
+// per-mesh position dequantization ("vqnt" chunk): position = position_min + position_extent * unorm16
+struct VertexQuantization {
+    glm::vec3 position_min = glm::vec3(0.0f);
+    glm::vec3 position_extent = glm::vec3(1.0f);
+};
+static_assert(sizeof(VertexQuantization) == 24, "VertexQuantization is packed");
+
+// attributes are laid out in order, each starting on a 4-byte boundary;
+//  the default encoding matches SkinnedVertex exactly
+inline std::vector<VertexAttribute> skinned_vertex_layout(VertexEncoding const &encoding = VertexEncoding()) {
+    std::vector<VertexAttribute> layout;
+    uint32_t offset = 0;
+    auto add = [&](uint32_t location, uint32_t size, uint32_t type, uint32_t normalized, uint32_t integer, uint32_t bytes) {
+        layout.push_back({location, size, type, normalized, integer, 0, offset});
+        offset += bytes;
+    };
+    if (encoding.quantized_positions) {
+        add(SkinPosition, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0, 8); // 6 bytes + 2 padding
+    } else {
+        add(SkinPosition, 3, GL_FLOAT, GL_FALSE, 0, 12);
+    }
+    if (encoding.oct_normals) {
+        add(SkinNormal, 2, GL_SHORT, GL_TRUE, 0, 4);
+    } else {
+        add(SkinNormal, 3, GL_FLOAT, GL_FALSE, 0, 12);
+    }
+    if (encoding.influences > 0) {
+        add(SkinBoneIDs, encoding.influences, GL_UNSIGNED_BYTE, GL_FALSE, 1, 4);
+        if (encoding.influences > 1) { // a single influence always has weight one
+            add(SkinBoneWeights, encoding.influences, GL_UNSIGNED_BYTE, GL_TRUE, 0, 4);
+        }
+    } else {
+        add(SkinBoneIDs, 4, GL_INT, GL_FALSE, 1, sizeof(BoneID));
+        add(SkinBoneWeights, 4, GL_FLOAT, GL_FALSE, 0, sizeof(BoneWeight));
+    }
+    for (auto &attribute : layout) {
+        attribute.stride = offset;
+    }
+    return layout;
+}
+
+// the attribute at 'location' in a layout, or nullptr:
+inline VertexAttribute const *find_attribute(std::vector<VertexAttribute> const &layout, uint32_t location) {
+    for (auto const &attribute : layout) {
+        if (attribute.location == location) return &attribute;
+    }
+    return nullptr;
+}
+
+// a small cluster of a mesh's triangles, with bounds for culling ("mshl" chunk, see build_meshlets.hpp)
+struct Meshlet {
+    uint32_t first_triangle; // covers triangles [first_triangle, first_triangle + triangle_count) of the mesh's index buffer
+    uint32_t triangle_count; //  (and the same triangles as three uint8 indices into its vertices in the "mltr" chunk)
+    uint32_t first_vertex; // its distinct vertices (as mesh vertex indices) are [first_vertex, first_vertex + vertex_count) of the "mlvx" chunk
+    uint32_t vertex_count;
+    uint32_t first_bone; // the bones influencing any of its vertices are [first_bone, first_bone + bone_count) of the "mlbn" chunk
+    uint32_t bone_count;
+    glm::vec3 center; // bounding sphere, in bind pose
+    float radius;
+    glm::vec3 cone_axis; // every triangle's normal is within cone_angle (radians) of cone_axis, in bind pose
+    float cone_angle;
+};
+static_assert(sizeof(Meshlet) == 56, "Meshlet is packed");
+
+// a simplified version of a mesh for drawing at a distance ("lods" chunk, see simplify_mesh.hpp):
+//  it uses the mesh's own vertices; its indices are in the "lodi" chunk, 16 bit if the mesh's are ("ix16") and 32 bit otherwise
+//  (or compressed in "zlod", see buffer_codec.hpp)
+struct MeshLOD {
+    uint32_t first_index; // covers indices [first_index, first_index + index_count) of the "lodi" chunk
+    uint32_t index_count;
+    float error; // how far (in model units) this level may deviate from the full mesh; divide by distance and
+                 //  multiply by the viewport's pixels per unit at distance 1 for the error in pixels
+    float triangle_ratio; // triangle count relative to the full mesh
+};
+static_assert(sizeof(MeshLOD) == 16, "MeshLOD is packed");
@@ -0,0 +1,888 @@
+#include "SkeletalAsset.hpp"
+#include "SkelFile.hpp"
+#include "buffer_codec.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+SkeletalAsset::SkeletalAsset(std::string const &filename, bool stream_clips) {
+	if (stream_clips) stream.reset(new SkelFile(filename, true));
+	std::unique_ptr< SkelFile > whole_file(stream ? nullptr : new SkelFile(filename));
+	SkelFile const &file = (stream ? *stream : *whole_file);
+
+	if (file.find("npar")) {
+		node_parents = file.read< int32_t >("npar");
+		std::vector< NodeBind > binds = file.read< NodeBind >("nbnd");
+		if (binds.size() != node_parents.size()) {
+			throw std::runtime_error("node bind transforms do not match the hierarchy");
+		}
+		for (auto const &bind : binds) {
+			node_bind_transforms.emplace_back(trs_to_mat4(bind.rotation, bind.translation, bind.scale));
+		}
+	} else {
+		//from before the dense hierarchy arrays:
+		for (auto const &node : file.read< Node >("node")) {
+			node_parents.emplace_back(node.parent_id);
+			node_bind_transforms.emplace_back(node.transform);
+		}
+	}
+	overall_transforms.resize(node_parents.size());
+	animations = file.read< Animation >("anim");
+	if (file.find("clip")) {
+		clips = file.read< Clip >("clip");
+	} else {
+		//from before clips: every channel is in one clip, with its keys at index 0
+		Clip clip;
+		std::memset(&clip, 0, sizeof(clip));
+		clip.ticks_per_second = 25.0f;
+		clip.sample_rate = 30.0f; //one key per frame, as the game played them
+		clip.channel_count = uint32_t(animations.size());
+		for (auto const &animation : animations) {
+			clip.num_frames = std::max(clip.num_frames, animation.num_frames);
+		}
+		clip.duration = float(clip.num_frames);
+		clips.emplace_back(clip);
+	}
+	if (file.count("qrot")) {
+		key_layout = KeyLayout::Quantized;
+	} else if (file.count("trsk")) {
+		key_layout = KeyLayout::TRS;
+	} else {
+		key_layout = KeyLayout::Mat4;
+	}
+
+	for (auto const &animation : animations) {
+		if (!(animation.node_id >= 0 && size_t(animation.node_id) < node_parents.size())) {
+			throw std::runtime_error("animation channel has out-of-range node id");
+		}
+	}
+	for (size_t i = 0; i < node_parents.size(); ++i) {
+		if (!(node_parents[i] < int32_t(i))) {
+			throw std::runtime_error("node hierarchy is not in parent-before-child order");
+		}
+	}
+	if (file.find("sock")) {
+		sockets = file.read< Socket >("sock");
+		for (auto &socket : sockets) {
+			socket.name[sizeof(socket.name) - 1] = '\0';
+			if (!(socket.node_id >= 0 && size_t(socket.node_id) < node_parents.size())) {
+				throw std::runtime_error("socket has out-of-range node id");
+			}
+		}
+	}
+	node_channels.resize(clips.size());
+	for (size_t c = 0; c < clips.size(); ++c) {
+		Clip &clip = clips[c];
+		clip.name[sizeof(clip.name) - 1] = '\0';
+		if (!(clip.sample_rate > 0.0f)) {
+			throw std::runtime_error("clip has no sample rate");
+		}
+		if (!(size_t(clip.first_channel) + clip.channel_count <= animations.size())) {
+			throw std::runtime_error("clip has out-of-range channels");
+		}
+		node_channels[c].assign(node_parents.size(), -1);
+		for (uint32_t a = clip.first_channel; a < clip.first_channel + clip.channel_count; ++a) {
+			node_channels[c][animations[a].node_id] = int(a);
+		}
+	}
+	if (!clips.empty() && file.find("nchn")) {
+		//the first clip's map is stored (older files don't have it, and keep the map built above):
+		std::vector< int32_t > stored = file.read< int32_t >("nchn");
+		if (stored.size() != node_parents.size()) {
+			throw std::runtime_error("node channel map does not match the hierarchy");
+		}
+		Clip const &clip = clips[0];
+		for (size_t n = 0; n < stored.size(); ++n) {
+			int32_t a = stored[n];
+			if (a == -1) continue;
+			if (!(a >= int32_t(clip.first_channel) && uint32_t(a) < clip.first_channel + clip.channel_count && animations[a].node_id == int(n))) {
+				throw std::runtime_error("node channel map has a channel that doesn't animate its node");
+			}
+		}
+		node_channels[0].assign(stored.begin(), stored.end());
+	}
+
+	uint32_t num_meshes = file.count("bone"); //the one chunk every mesh has, whatever its vertex / index format
+	meshes.resize(num_meshes);
+	for (uint32_t m = 0; m < num_meshes; ++m) {
+		MeshData &mesh = meshes[m];
+		mesh.bones = file.read< Bone >("bone", m);
+		for (auto const &bone : mesh.bones) {
+			if (!(bone.node_id >= 0 && size_t(bone.node_id) < node_parents.size())) {
+				throw std::runtime_error("bone has out-of-range node id");
+			}
+		}
+		if (file.find("ghsh", m)) {
+			std::vector< uint64_t > hash = file.read< uint64_t >("ghsh", m);
+			if (hash.size() != 1) {
+				throw std::runtime_error("geometry hash chunk has the wrong size");
+			}
+			mesh.geometry_hash = hash[0];
+		}
+		if (file.find("gref", m)) {
+			//same vertices + indices as an earlier mesh, which were only stored once:
+			std::vector< uint32_t > source = file.read< uint32_t >("gref", m);
+			if (source.size() != 1 || source[0] >= m || meshes[source[0]].bones.size() != mesh.bones.size()) {
+				throw std::runtime_error("mesh refers to bad geometry");
+			}
+			std::vector< Bone > own_bones = std::move(mesh.bones);
+			mesh = meshes[source[0]];
+			mesh.bones = std::move(own_bones);
+			mesh.geometry_source = source[0];
+		} else {
+			if (file.find("strm", m) || file.find("zstr", m)) {
+				mesh.vertex_layout = file.read< VertexAttribute >("vfmt", m);
+				size_t stride = (mesh.vertex_layout.empty() ? 0 : mesh.vertex_layout[0].stride);
+				if (file.find("zstr", m)) {
+					size_t encoded_stride = 0;
+					decode_vertex_buffer(file.read< uint8_t >("zstr", m), &mesh.vertex_stream, &encoded_stride);
+					if (encoded_stride != stride) {
+						throw std::runtime_error("compressed vertex stream does not match its layout");
+					}
+				} else {
+					mesh.vertex_stream = file.read< uint8_t >("strm", m);
+				}
+				if (stride == 0 || mesh.vertex_stream.size() % stride != 0) {
+					throw std::runtime_error("vertex stream size does not match its layout");
+				}
+				mesh.vertex_count = uint32_t(mesh.vertex_stream.size() / mesh.vertex_layout[0].stride);
+				VertexAttribute const *position = find_attribute(mesh.vertex_layout, SkinPosition);
+				VertexAttribute const *normal = find_attribute(mesh.vertex_layout, SkinNormal);
+				if (!position || !normal) {
+					throw std::runtime_error("vertex layout is missing position or normal");
+				}
+				mesh.quantized_positions = (position->type != GL_FLOAT);
+				if (mesh.quantized_positions) {
+					std::vector< VertexQuantization > quantization = file.read< VertexQuantization >("vqnt", m);
+					if (quantization.size() != 1) {
+						throw std::runtime_error("quantized positions need exactly one dequantization entry");
+					}
+					mesh.quantization = quantization[0];
+				}
+				mesh.oct_normals = (normal->size == 2);
+				VertexAttribute const *bone_ids = find_attribute(mesh.vertex_layout, SkinBoneIDs);
+				if (!bone_ids) {
+					throw std::runtime_error("vertex layout is missing bone ids");
+				}
+				if (bone_ids->type == GL_UNSIGNED_BYTE) {
+					mesh.influences = bone_ids->size;
+					if (!(mesh.influences == 1 || mesh.influences == 2 || mesh.influences == 4)) {
+						throw std::runtime_error("vertex layout has unsupported influence count");
+					}
+				}
+			} else {
+				//planar arrays: interleave them so the GL side only has one path
+				std::vector< float > vertices = file.read< float >("vert", m);
+				std::vector< float > normals = file.read< float >("norm", m);
+				std::vector< BoneWeight > bone_weights = file.read< BoneWeight >("weig", m);
+				std::vector< BoneID > bone_ids = file.read< BoneID >("idss", m);
+				mesh.vertex_count = uint32_t(vertices.size() / 3);
+				if (normals.size() != vertices.size() || bone_weights.size() != mesh.vertex_count || bone_ids.size() != mesh.vertex_count) {
+					throw std::runtime_error("planar vertex arrays have mismatched sizes");
+				}
+				std::vector< SkinnedVertex > stream(mesh.vertex_count);
+				for (uint32_t v = 0; v < mesh.vertex_count; ++v) {
+					stream[v].position = glm::vec3(vertices[3*v+0], vertices[3*v+1], vertices[3*v+2]);
+					stream[v].normal = glm::vec3(normals[3*v+0], normals[3*v+1], normals[3*v+2]);
+					stream[v].bone_ids = bone_ids[v];
+					stream[v].bone_weights = bone_weights[v];
+				}
+				mesh.vertex_stream.resize(stream.size() * sizeof(SkinnedVertex));
+				std::memcpy(mesh.vertex_stream.data(), stream.data(), mesh.vertex_stream.size());
+				mesh.vertex_layout = skinned_vertex_layout();
+			}
+			auto check_indices = [&mesh](auto const &indices, char const *what) {
+				for (auto index : indices) {
+					if (index >= mesh.vertex_count) {
+						throw std::runtime_error(std::string(what) + " has out-of-range index");
+					}
+				}
+			};
+			//(compressed indices are 16 bit whenever the vertices allow it, as the exporter does for "ix16")
+			mesh.index_type = (file.find("ix16", m) || (file.find("zidx", m) && mesh.vertex_count < 65536) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+			if (file.find("zidx", m)) {
+				std::vector< unsigned int > decoded = decode_index_buffer(file.read< uint8_t >("zidx", m));
+				check_indices(decoded, "mesh"); //(before narrowing, which would hide bad indices)
+				if (mesh.index_type == GL_UNSIGNED_SHORT) mesh.indices16.assign(decoded.begin(), decoded.end());
+				else mesh.indices = std::move(decoded);
+			} else if (mesh.index_type == GL_UNSIGNED_SHORT) {
+				mesh.indices16 = file.read< uint16_t >("ix16", m);
+				check_indices(mesh.indices16, "mesh");
+			} else {
+				mesh.indices = file.read< unsigned int >("indi", m);
+				check_indices(mesh.indices, "mesh");
+			}
+			if (file.find("mshl", m)) {
+				mesh.meshlets = file.read< Meshlet >("mshl", m);
+				mesh.meshlet_bones = file.read< uint32_t >("mlbn", m);
+				for (auto const &meshlet : mesh.meshlets) {
+					if (!(size_t(meshlet.first_triangle) + meshlet.triangle_count <= mesh.index_count() / 3
+						&& size_t(meshlet.first_bone) + meshlet.bone_count <= mesh.meshlet_bones.size())) {
+						throw std::runtime_error("meshlet has out-of-range triangles or bones");
+					}
+				}
+				for (auto bone : mesh.meshlet_bones) {
+					if (bone >= mesh.bones.size()) {
+						throw std::runtime_error("meshlet has out-of-range bone");
+					}
+				}
+			}
+			if (file.find("lods", m)) {
+				mesh.lods = file.read< MeshLOD >("lods", m);
+				if (file.find("zlod", m)) {
+					std::vector< unsigned int > decoded = decode_index_buffer(file.read< uint8_t >("zlod", m));
+					check_indices(decoded, "LOD");
+					if (mesh.index_type == GL_UNSIGNED_SHORT) mesh.lod_indices16.assign(decoded.begin(), decoded.end());
+					else mesh.lod_indices = std::move(decoded);
+				} else if (mesh.index_type == GL_UNSIGNED_SHORT) {
+					mesh.lod_indices16 = file.read< uint16_t >("lodi", m);
+					check_indices(mesh.lod_indices16, "LOD");
+				} else {
+					mesh.lod_indices = file.read< unsigned int >("lodi", m);
+					check_indices(mesh.lod_indices, "LOD");
+				}
+				for (auto const &lod : mesh.lods) {
+					if (!(size_t(lod.first_index) + lod.index_count <= mesh.lod_index_count() && lod.index_count % 3 == 0)) {
+						throw std::runtime_error("LOD has out-of-range indices");
+					}
+				}
+			}
+		}
+		mesh.palette_offset = palette_bone_map_size;
+		palette_bone_map_size += uint32_t(mesh.bones.size());
+		mesh.vertex_animation_offset = total_vertices;
+		total_vertices += mesh.vertex_count;
+	}
+
+	//one skeleton shared by every mesh (files from before "skbn" get one built here, the same way the exporter does):
+	if (file.find("skbn")) {
+		skeleton = file.read< Bone >("skbn");
+		for (auto const &bone : skeleton) {
+			if (!(bone.node_id >= 0 && size_t(bone.node_id) < node_parents.size())) {
+				throw std::runtime_error("skeleton bone has out-of-range node id");
+			}
+		}
+		for (uint32_t m = 0; m < num_meshes; ++m) {
+			MeshData &mesh = meshes[m];
+			mesh.bone_map = file.read< uint32_t >("bmap", m);
+			if (mesh.bone_map.size() != mesh.bones.size()) {
+				throw std::runtime_error("bone map does not match the mesh's bones");
+			}
+			for (auto bone : mesh.bone_map) {
+				if (bone >= skeleton.size()) {
+					throw std::runtime_error("bone map has out-of-range bone");
+				}
+			}
+		}
+	} else {
+		SkeletonBuilder builder;
+		for (auto &mesh : meshes) {
+			mesh.bone_map.clear();
+			for (auto const &bone : mesh.bones) {
+				mesh.bone_map.emplace_back(builder.add(bone));
+			}
+		}
+		skeleton = std::move(builder.bones);
+	}
+	palette_size = uint32_t(skeleton.size());
+
+	//(after the meshes, since baked palettes / vertex animation are checked against their bone / vertex counts)
+	clip_keys.resize(clips.size());
+	if (!stream) {
+		for (uint32_t c = 0; c < clips.size(); ++c) {
+			read_clip_keys(file, c);
+		}
+	}
+}
+
+int SkeletalAsset::find_clip(std::string const &name) const {
+	for (size_t c = 0; c < clips.size(); ++c) {
+		if (name == clips[c].name) return int(c);
+	}
+	return -1;
+}
+
+int SkeletalAsset::find_socket(std::string const &name) const {
+	for (auto const &socket : sockets) {
+		if (name == socket.name) return socket.node_id;
+	}
+	return -1;
+}
+
+void SkeletalAsset::read_clip_keys(SkelFile const &file, unsigned int clip) {
+	Clip const &info = clips.at(clip);
+	ClipKeys &pool = clip_keys.at(clip);
+	size_t num_keys = 0;
+	size_t num_scales = 0;
+	if (key_layout == KeyLayout::Quantized) {
+		pool.packed_rotations = file.read< PackedQuat >("qrot", clip);
+		pool.packed_translations = file.read< QuantizedVec3 >("qpos", clip);
+		pool.packed_scales = file.read< QuantizedVec3 >("qscl", clip);
+		pool.ranges = file.read< QuantizedRange >("qrng", clip);
+		if (pool.packed_translations.size() != pool.packed_rotations.size() || pool.ranges.size() != info.channel_count) {
+			throw std::runtime_error("quantized key chunks have mismatched sizes");
+		}
+		num_keys = pool.packed_rotations.size();
+		num_scales = pool.packed_scales.size();
+	} else if (key_layout == KeyLayout::TRS) {
+		pool.trs_keys = file.read< TRSKey >("trsk", clip);
+		pool.scale_keys = file.read< glm::vec3 >("scal", clip);
+		num_keys = pool.trs_keys.size();
+		num_scales = pool.scale_keys.size();
+	} else {
+		pool.keys = file.read< glm::mat4 >("keys", clip);
+		num_keys = pool.keys.size();
+	}
+	if (file.find("kfrm", clip)) {
+		pool.key_frames = file.read< uint16_t >("kfrm", clip);
+		if (pool.key_frames.size() != num_keys) {
+			throw std::runtime_error("key frame chunk does not match key pool size");
+		}
+	}
+
+	if (file.find("pall", clip)) {
+		pool.palette = file.read< PaletteMatrix >("pall", clip);
+		size_t frames = size_t(std::max(0, info.num_frames));
+		if (pool.palette.size() != frames * palette_size && pool.palette.size() == frames * palette_bone_map_size) {
+			//older files bake every mesh's bones in turn, shared bones repeated: keep one copy of each skeleton bone
+			std::vector< PaletteMatrix > per_mesh = std::move(pool.palette);
+			pool.palette.assign(frames * palette_size, PaletteMatrix());
+			for (size_t f = 0; f < frames; ++f) {
+				for (auto const &mesh : meshes) {
+					for (size_t b = 0; b < mesh.bone_map.size(); ++b) {
+						pool.palette[f * palette_size + mesh.bone_map[b]] = per_mesh[f * palette_bone_map_size + mesh.palette_offset + b];
+					}
+				}
+			}
+		}
+		if (pool.palette.size() != frames * palette_size) {
+			throw std::runtime_error("baked palette does not match clip frames and bone count");
+		}
+	}
+	if (file.find("vati", clip)) {
+		std::vector< VertexAnimationInfo > vertex_animation = file.read< VertexAnimationInfo >("vati", clip);
+		if (vertex_animation.size() != 1) {
+			throw std::runtime_error("vertex animation needs exactly one info entry");
+		}
+		VertexAnimationInfo const &va = vertex_animation[0];
+		size_t texel_size = (va.type == GL_HALF_FLOAT ? 4 * sizeof(uint16_t) : va.type == GL_FLOAT ? 4 * sizeof(float) : 0);
+		if (texel_size == 0 || va.vertex_count != total_vertices || va.width == 0 || size_t(va.width) * va.rows_per_frame < va.vertex_count) {
+			throw std::runtime_error("vertex animation info does not match meshes");
+		}
+		pool.vertex_animation = va;
+		pool.animated_positions = file.read< char >("vatp", clip);
+		pool.animated_normals = file.read< char >("vatn", clip);
+		size_t size = size_t(std::max(0, info.num_frames)) * va.rows_per_frame * va.width * texel_size;
+		if (pool.animated_positions.size() != size || pool.animated_normals.size() != size) {
+			throw std::runtime_error("vertex animation does not match clip frames and vertex count");
+		}
+	}
+
+	for (uint32_t a = info.first_channel; a < info.first_channel + info.channel_count; ++a) {
+		Animation const &animation = animations[a];
+		if (!(animation.num_frames > 0 && animation.num_keys > 0 && animation.first_key >= 0 && size_t(animation.first_key) + size_t(animation.num_keys) <= num_keys)) {
+			throw std::runtime_error("animation channel has out-of-range key range");
+		}
+		if (pool.key_frames.empty() && animation.num_keys != animation.num_frames) {
+			throw std::runtime_error("animation channel has fewer keys than frames but no key frames");
+		}
+		if (key_layout != KeyLayout::Mat4 && animation.first_scale != -1 && !(animation.first_scale >= 0 && size_t(animation.first_scale) + size_t(animation.num_keys) <= num_scales)) {
+			throw std::runtime_error("animation channel has out-of-range scale range");
+		}
+	}
+	pool.loaded = true;
+}
+
+float SkeletalAsset::clip_length(unsigned int clip) const {
+	Clip const &info = clips.at(clip);
+	return float(std::max(0, info.num_frames - 1)) / info.sample_rate;
+}
+
+float SkeletalAsset::frame_at(unsigned int clip, float seconds) const {
+	Clip const &info = clips.at(clip);
+	return std::max(0.0f, std::min(seconds * info.sample_rate, float(std::max(0, info.num_frames - 1))));
+}
+
+void SkeletalAsset::load_clip(unsigned int clip) {
+	if (clip_keys.at(clip).loaded) return;
+	if (!stream) {
+		throw std::runtime_error("clip " + std::to_string(clip) + " was unloaded but the asset isn't streamed");
+	}
+	read_clip_keys(*stream, clip);
+}
+
+void SkeletalAsset::unload_clip(unsigned int clip) {
+	if (!stream) return;
+	clip_keys.at(clip) = ClipKeys();
+}
+
+void SkeletalAsset::update_nodes(unsigned int clip, float frame) {
+	load_clip(clip);
+	ClipKeys const &pool = clip_keys.at(clip);
+	uint32_t first_channel = clips[clip].first_channel;
+	if (key_layout == KeyLayout::Quantized) {
+		decode_frame(clip, frame, &decoded_keys, &decoded_scales);
+	}
+
+	//parents come first, so this is one pass front to back over the arrays:
+	std::vector< int > const &channels = node_channels[clip];
+	for (size_t i = 0; i < node_parents.size(); ++i) {
+		int channel = channels[i];
+		glm::mat4 local = node_bind_transforms[i];
+		if (channel >= 0 && key_layout == KeyLayout::Quantized) {
+			size_t c = size_t(channel) - first_channel;
+			local = trs_to_mat4(decoded_keys[c].rotation, decoded_keys[c].translation, decoded_scales[c]);
+		} else if (channel >= 0) {
+			local = sample(pool, animations[channel], frame);
+		}
+		int32_t parent = node_parents[i];
+		overall_transforms[i] = (parent >= 0 ? overall_transforms[parent] * local : local);
+	}
+}
+
+void SkeletalAsset::find_keys(ClipKeys const &pool, Animation const &animation, float frame, int *k0_, int *k1_, float *t_) const {
+	auto const &key_frames = pool.key_frames;
+	assert(k0_ && k1_ && t_);
+	frame = std::max(0.0f, std::min(frame, float(animation.num_frames - 1)));
+
+	int k0 = 0;
+	if (key_frames.empty()) {
+		//one key per frame, at a uniform rate: no search needed
+		k0 = std::min(int(frame), animation.num_keys - 1);
+	} else {
+		//reduced keys: last key at or before frame
+		auto begin = key_frames.begin() + animation.first_key;
+		auto end = begin + animation.num_keys;
+		k0 = std::max(0, int(std::upper_bound(begin, end, frame, [](float f, uint16_t k) { return f < float(k); }) - begin) - 1);
+	}
+	int k1 = std::min(k0 + 1, animation.num_keys - 1);
+
+	float f0 = float(key_frames.empty() ? k0 : key_frames[animation.first_key + k0]);
+	float f1 = float(key_frames.empty() ? k1 : key_frames[animation.first_key + k1]);
+	*k0_ = k0;
+	*k1_ = k1;
+	*t_ = (f1 > f0 ? std::max(0.0f, std::min(1.0f, (frame - f0) / (f1 - f0))) : 0.0f);
+}
+
+glm::mat4 SkeletalAsset::sample(ClipKeys const &pool, Animation const &animation, float frame) const {
+	assert(key_layout != KeyLayout::Quantized);
+	int k0, k1;
+	float t;
+	find_keys(pool, animation, frame, &k0, &k1, &t);
+
+	if (key_layout == KeyLayout::Mat4) {
+		return pool.keys[animation.first_key + k0];
+	}
+
+	TRSKey const &a = pool.trs_keys[animation.first_key + k0];
+	TRSKey const &b = pool.trs_keys[animation.first_key + k1];
+	glm::vec3 scale(1.0f);
+	if (animation.first_scale != -1) {
+		scale = glm::mix(pool.scale_keys[animation.first_scale + k0], pool.scale_keys[animation.first_scale + k1], t);
+	}
+	return trs_to_mat4(glm::slerp(a.rotation, b.rotation, t), glm::mix(a.translation, b.translation, t), scale);
+}
+
+void SkeletalAsset::decode_frame(unsigned int clip, float frame, std::vector< TRSKey > *keys_, std::vector< glm::vec3 > *scales_) const {
+	assert(keys_);
+	assert(scales_);
+	auto &out_keys = *keys_;
+	auto &out_scales = *scales_;
+	Clip const &info = clips.at(clip);
+	ClipKeys const &pool = clip_keys.at(clip);
+	if (!pool.loaded) {
+		throw std::runtime_error("clip '" + std::string(info.name) + "' is not loaded");
+	}
+	out_keys.resize(info.channel_count);
+	out_scales.resize(info.channel_count);
+
+	auto unpack_vec3 = [](QuantizedVec3 const &q, glm::vec3 const &min, glm::vec3 const &extent) {
+		return glm::vec3(
+			dequantize_unorm16(q.v[0], min.x, extent.x),
+			dequantize_unorm16(q.v[1], min.y, extent.y),
+			dequantize_unorm16(q.v[2], min.z, extent.z)
+		);
+	};
+
+	for (size_t c = 0; c < info.channel_count; ++c) {
+		Animation const &animation = animations[info.first_channel + c];
+		QuantizedRange const &range = pool.ranges[c];
+		int k0, k1;
+		float t;
+		find_keys(pool, animation, frame, &k0, &k1, &t);
+
+		out_keys[c].rotation = glm::slerp(
+			unpack_quat(pool.packed_rotations[animation.first_key + k0]),
+			unpack_quat(pool.packed_rotations[animation.first_key + k1]), t);
+		out_keys[c].translation = glm::mix(
+			unpack_vec3(pool.packed_translations[animation.first_key + k0], range.translation_min, range.translation_extent),
+			unpack_vec3(pool.packed_translations[animation.first_key + k1], range.translation_min, range.translation_extent), t);
+
+		if (animation.first_scale != -1) {
+			out_scales[c] = glm::mix(
+				unpack_vec3(pool.packed_scales[animation.first_scale + k0], range.scale_min, range.scale_extent),
+				unpack_vec3(pool.packed_scales[animation.first_scale + k1], range.scale_min, range.scale_extent), t);
+		} else {
+			out_scales[c] = glm::vec3(1.0f);
+		}
+	}
+}
+
+void SkeletalAsset::get_bone_transforms(unsigned int mesh, std::vector< glm::mat4 > *bone_transforms_) const {
+	assert(bone_transforms_);
+	auto &bone_transforms = *bone_transforms_;
+	auto const &bones = meshes.at(mesh).bones;
+
+	bone_transforms.resize(bones.size());
+	for (size_t b = 0; b < bones.size(); ++b) {
+		bone_transforms[b] = node_bind_transforms[0] * overall_transforms[bones[b].node_id] * bones[b].inverse_binding;
+	}
+}
+
+void SkeletalAsset::get_skeleton_transforms(std::vector< glm::mat4 > *skeleton_transforms_) const {
+	assert(skeleton_transforms_);
+	auto &skeleton_transforms = *skeleton_transforms_;
+
+	skeleton_transforms.resize(skeleton.size());
+	for (size_t b = 0; b < skeleton.size(); ++b) {
+		skeleton_transforms[b] = node_bind_transforms[0] * overall_transforms[skeleton[b].node_id] * skeleton[b].inverse_binding;
+	}
+}
+
+void SkeletalAsset::get_bone_transforms(unsigned int mesh, std::vector< glm::mat4 > const &skeleton_transforms, std::vector< glm::mat4 > *bone_transforms_) const {
+	assert(bone_transforms_);
+	auto &bone_transforms = *bone_transforms_;
+	auto const &bone_map = meshes.at(mesh).bone_map;
+	assert(skeleton_transforms.size() == skeleton.size());
+
+	bone_transforms.resize(bone_map.size());
+	for (size_t b = 0; b < bone_map.size(); ++b) {
+		bone_transforms[b] = skeleton_transforms[bone_map[b]];
+	}
+}
+
+void SkeletalAsset::cull_meshlets(unsigned int mesh, std::vector< glm::mat4 > const &bone_transforms,
+	glm::mat4 const &world_to_clip, glm::vec3 const &eye, bool cull_backfaces, std::vector< uint32_t > *visible_) const {
+	assert(visible_);
+	auto &visible = *visible_;
+	MeshData const &data = meshes.at(mesh);
+	visible.clear();
+
+	//frustum planes (Gribb & Hartmann): a point p is inside if dot(plane, vec4(p, 1)) >= 0 for all six
+	glm::vec4 planes[6];
+	for (int i = 0; i < 3; ++i) {
+		glm::vec4 row(world_to_clip[0][i], world_to_clip[1][i], world_to_clip[2][i], world_to_clip[3][i]);
+		glm::vec4 w(world_to_clip[0][3], world_to_clip[1][3], world_to_clip[2][3], world_to_clip[3][3]);
+		planes[2*i+0] = w + row;
+		planes[2*i+1] = w - row;
+	}
+	for (auto &plane : planes) {
+		plane *= 1.0f / glm::length(glm::vec3(plane));
+	}
+
+	const float HalfPi = 1.57079632679f;
+	for (uint32_t i = 0; i < data.meshlets.size(); ++i) {
+		Meshlet const &meshlet = data.meshlets[i];
+
+		//skinned vertices are blends of each bone moving the bind pose vertex,
+		// so they lie within the spheres / cones moved by each bone of the meshlet:
+		glm::vec3 center = meshlet.center;
+		float radius = meshlet.radius;
+		glm::vec3 axis = meshlet.cone_axis;
+		float angle = meshlet.cone_angle;
+		if (meshlet.bone_count > 0 && !bone_transforms.empty()) {
+			glm::vec3 center_sum(0.0f), axis_sum(0.0f);
+			for (uint32_t b = 0; b < meshlet.bone_count; ++b) {
+				glm::mat4 const &bone = bone_transforms[data.meshlet_bones[meshlet.first_bone + b]];
+				center_sum += glm::vec3(bone * glm::vec4(meshlet.center, 1.0f));
+				axis_sum += glm::normalize(glm::mat3(bone) * meshlet.cone_axis);
+			}
+			center = center_sum / float(meshlet.bone_count);
+			float axis_length = glm::length(axis_sum);
+			axis = (axis_length > 0.0f ? axis_sum / axis_length : meshlet.cone_axis);
+			float spread = 0.0f, scale = 0.0f, widen = (axis_length > 0.0f ? 0.0f : HalfPi * 2.0f);
+			for (uint32_t b = 0; b < meshlet.bone_count; ++b) {
+				glm::mat4 const &bone = bone_transforms[data.meshlet_bones[meshlet.first_bone + b]];
+				spread = std::max(spread, glm::length(glm::vec3(bone * glm::vec4(meshlet.center, 1.0f)) - center));
+				scale = std::max(scale, std::max(glm::length(glm::vec3(bone[0])), std::max(glm::length(glm::vec3(bone[1])), glm::length(glm::vec3(bone[2])))));
+				float d = glm::dot(glm::normalize(glm::mat3(bone) * meshlet.cone_axis), axis);
+				widen = std::max(widen, std::acos(std::max(-1.0f, std::min(1.0f, d))));
+			}
+			radius = spread + radius * scale;
+			angle += widen;
+		}
+
+		bool outside = false;
+		for (auto const &plane : planes) {
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) outside = true;
+		}
+		if (outside) continue;
+
+		if (cull_backfaces && angle < HalfPi) {
+			//every normal points away from the eye if the cone, widened by the sphere's apparent size, is within 90 degrees of the view direction:
+			glm::vec3 to_center = center - eye;
+			float distance = glm::length(to_center);
+			if (distance > radius) {
+				float view_angle = std::acos(std::max(-1.0f, std::min(1.0f, glm::dot(to_center / distance, axis))));
+				if (view_angle + angle + std::asin(radius / distance) < HalfPi) continue;
+			}
+		}
+
+		visible.emplace_back(i);
+	}
+}
+
+unsigned int SkeletalAsset::select_lod(unsigned int mesh, float distance, float pixels_per_unit, float max_pixel_error) const {
+	MeshData const &data = meshes.at(mesh);
+	if (distance <= 0.0f) return 0;
+	unsigned int lod = 0;
+	//errors grow with each level, so stop at the first one that is too coarse:
+	for (size_t l = 0; l < data.lods.size(); ++l) {
+		if (data.lods[l].error * pixels_per_unit / distance > max_pixel_error) break;
+		lod = unsigned(l + 1);
+	}
+	return lod;
+}
+
+//GPU meshes already uploaded, by geometry hash, so identical geometry in different assets shares buffers:
+// (like the rest of the GL objects here, these are never freed)
+static std::unordered_map< uint64_t, SkeletalAsset::GPUMesh > &uploaded_geometry() {
+	static std::unordered_map< uint64_t, SkeletalAsset::GPUMesh > uploaded;
+	return uploaded;
+}
+
+void SkeletalAsset::upload() {
+	gpu_meshes.resize(meshes.size());
+	for (size_t m = 0; m < meshes.size(); ++m) {
+		MeshData const &mesh = meshes[m];
+		GPUMesh &gpu = gpu_meshes[m];
+
+		//geometry already on the GPU (an earlier mesh's, or an identical mesh from any asset) isn't uploaded again:
+		if (mesh.geometry_source >= 0) {
+			gpu = gpu_meshes[mesh.geometry_source];
+			continue;
+		}
+		if (mesh.geometry_hash != 0) {
+			auto f = uploaded_geometry().find(mesh.geometry_hash);
+			if (f != uploaded_geometry().end()) {
+				gpu = f->second;
+				continue;
+			}
+		}
+
+		glGenVertexArrays(1, &gpu.vao);
+		glGenBuffers(1, &gpu.vertex_buffer);
+		glGenBuffers(1, &gpu.index_buffer);
+
+		glBindVertexArray(gpu.vao);
+
+		glBindBuffer(GL_ARRAY_BUFFER, gpu.vertex_buffer);
+		glBufferData(GL_ARRAY_BUFFER, mesh.vertex_stream.size(), mesh.vertex_stream.data(), GL_STATIC_DRAW);
+		for (auto const &attribute : mesh.vertex_layout) {
+			if (attribute.integer) {
+				glVertexAttribIPointer(attribute.location, attribute.size, attribute.type, attribute.stride, (GLbyte *)0 + attribute.offset);
+			} else {
+				glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE, attribute.stride, (GLbyte *)0 + attribute.offset);
+			}
+			glEnableVertexAttribArray(attribute.location);
+		}
+
+		//one index buffer: the full mesh, then all of its LODs (straight from the loaded arrays, no staging copy)
+		bool short_indices = (mesh.index_type == GL_UNSIGNED_SHORT);
+		size_t index_size = (short_indices ? sizeof(uint16_t) : sizeof(unsigned int));
+		size_t full_bytes = mesh.index_count() * index_size;
+		size_t lod_bytes = mesh.lod_index_count() * index_size;
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.index_buffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(full_bytes + lod_bytes), nullptr, GL_STATIC_DRAW);
+		if (full_bytes) {
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, GLsizeiptr(full_bytes),
+				short_indices ? static_cast< void const * >(mesh.indices16.data()) : static_cast< void const * >(mesh.indices.data()));
+		}
+		if (lod_bytes) {
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, GLintptr(full_bytes), GLsizeiptr(lod_bytes),
+				short_indices ? static_cast< void const * >(mesh.lod_indices16.data()) : static_cast< void const * >(mesh.lod_indices.data()));
+		}
+		gpu.elements = GLsizei(mesh.index_count());
+		gpu.index_type = mesh.index_type;
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		if (mesh.geometry_hash != 0) uploaded_geometry().emplace(mesh.geometry_hash, gpu);
+	}
+
+	palette_textures.resize(clips.size(), 0);
+	vertex_animation_textures.resize(clips.size());
+	for (uint32_t c = 0; c < clips.size(); ++c) {
+		if (!clip_keys[c].palette.empty()) upload_palette(c);
+		if (!clip_keys[c].animated_positions.empty()) upload_vertex_animation(c);
+	}
+}
+
+void SkeletalAsset::upload_palette(unsigned int clip) {
+	load_clip(clip);
+	ClipKeys const &pool = clip_keys.at(clip);
+	if (pool.palette.empty()) {
+		throw std::runtime_error("clip " + std::to_string(clip) + " has no baked palette");
+	}
+	GLint max_size = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+	if (3 * size_t(palette_size) > size_t(max_size) || size_t(clips[clip].num_frames) > size_t(max_size)
+		|| size_t(palette_bone_map_size) > size_t(max_size)) {
+		throw std::runtime_error("baked palette of clip " + std::to_string(clip) + " (" + std::to_string(palette_size) + " bones x "
+			+ std::to_string(clips[clip].num_frames) + " frames) is larger than GL_MAX_TEXTURE_SIZE " + std::to_string(max_size));
+	}
+
+	//every mesh's bone map, one after another, as a single row of ints (the same for every clip):
+	if (palette_bone_map == 0) {
+		std::vector< GLint > bone_map;
+		for (auto const &mesh : meshes) {
+			bone_map.insert(bone_map.end(), mesh.bone_map.begin(), mesh.bone_map.end());
+		}
+		if (bone_map.empty()) bone_map.emplace_back(0);
+		glGenTextures(1, &palette_bone_map);
+		glBindTexture(GL_TEXTURE_2D, palette_bone_map);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R32I, GLsizei(bone_map.size()), 1, 0, GL_RED_INTEGER, GL_INT, bone_map.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	palette_textures.resize(clips.size(), 0);
+	GLuint &tex = palette_textures[clip];
+	if (tex == 0) glGenTextures(1, &tex);
+
+	//one row per frame, three RGBA32F texels (the rows of a mat4x3) per skeleton bone:
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, GLsizei(3 * palette_size), GLsizei(clips[clip].num_frames), 0, GL_RGBA, GL_FLOAT, pool.palette.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool SkeletalAsset::has_palette(unsigned int clip) const {
+	return clip < palette_textures.size() && palette_textures[clip] != 0;
+}
+
+void SkeletalAsset::bind_palette(unsigned int mesh, GLuint program, unsigned int clip, unsigned int frame) const {
+	bind_palette(std::vector< unsigned int >{mesh}, program, clip, frame);
+}
+
+void SkeletalAsset::bind_palette(std::vector< unsigned int > const &same_geometry, GLuint program, unsigned int clip, unsigned int frame) const {
+	GLuint tex = (clip < palette_textures.size() ? palette_textures[clip] : 0);
+	if (tex == 0) {
+		throw std::runtime_error("clip " + std::to_string(clip) + " has no uploaded palette");
+	}
+	if (same_geometry.empty() || same_geometry.size() > MaxPaletteInstances) {
+		throw std::runtime_error("can't draw " + std::to_string(same_geometry.size()) + " palette instances at once");
+	}
+	std::vector< GLint > offsets;
+	for (auto m : same_geometry) {
+		if (gpu_meshes.at(m).vao != gpu_meshes.at(same_geometry[0]).vao) {
+			throw std::runtime_error("palette instances of mesh " + std::to_string(same_geometry[0]) + " don't all share its geometry");
+		}
+		offsets.emplace_back(GLint(meshes.at(m).palette_offset));
+	}
+	glUseProgram(program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glUniform1i(glGetUniformLocation(program, "Palette"), 0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, palette_bone_map);
+	glUniform1i(glGetUniformLocation(program, "PaletteBones"), 1);
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i(glGetUniformLocation(program, "PaletteFrame"), GLint(std::min(frame, uint32_t(std::max(0, clips[clip].num_frames - 1)))));
+	glUniform1iv(glGetUniformLocation(program, "PaletteOffsets"), GLsizei(offsets.size()), offsets.data());
+}
+
+void SkeletalAsset::draw(unsigned int mesh, GLuint program, std::vector< glm::mat4 > const &bone_transforms,
+	std::vector< uint32_t > const *visible_meshlets, unsigned int lod, GLsizei instances) const {
+	GPUMesh const &gpu = gpu_meshes.at(mesh);
+
+	glUseProgram(program);
+	if (!bone_transforms.empty()) {
+		GLint bone_transforms_id = glGetUniformLocation(program, "BoneTransforms");
+		glUniformMatrix4fv(bone_transforms_id, GLsizei(bone_transforms.size()), GL_FALSE, glm::value_ptr(bone_transforms[0]));
+	}
+	MeshData const &data = meshes.at(mesh);
+	glUniform1i(glGetUniformLocation(program, "QuantizedPositions"), data.quantized_positions ? 1 : 0);
+	glUniform3fv(glGetUniformLocation(program, "PositionMin"), 1, glm::value_ptr(data.quantization.position_min));
+	glUniform3fv(glGetUniformLocation(program, "PositionExtent"), 1, glm::value_ptr(data.quantization.position_extent));
+	glUniform1i(glGetUniformLocation(program, "OctNormals"), data.oct_normals ? 1 : 0);
+
+	glBindVertexArray(gpu.vao);
+	if (visible_meshlets) {
+		//each meshlet is a contiguous range of the index buffer:
+		GLsizei index_size = (gpu.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+		std::vector< GLsizei > counts;
+		std::vector< void const * > offsets;
+		for (auto i : *visible_meshlets) {
+			Meshlet const &meshlet = data.meshlets.at(i);
+			counts.emplace_back(GLsizei(3 * meshlet.triangle_count));
+			offsets.emplace_back((GLbyte *)0 + size_t(3 * meshlet.first_triangle) * index_size);
+		}
+		if (!counts.empty()) {
+			glMultiDrawElements(GL_TRIANGLES, counts.data(), gpu.index_type, offsets.data(), GLsizei(counts.size()));
+		}
+	} else if (lod > 0) {
+		MeshLOD const &level = data.lods.at(lod - 1);
+		GLsizei index_size = (gpu.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+		glDrawElementsInstanced(GL_TRIANGLES, GLsizei(level.index_count), gpu.index_type,
+			(GLbyte *)0 + (size_t(gpu.elements) + level.first_index) * index_size, instances);
+	} else {
+		glDrawElementsInstanced(GL_TRIANGLES, gpu.elements, gpu.index_type, 0, instances);
+	}
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
+
+bool SkeletalAsset::has_vertex_animation(unsigned int clip) const {
+	return clip < vertex_animation_textures.size() && vertex_animation_textures[clip].positions != 0;
+}
+
+void SkeletalAsset::upload_vertex_animation(unsigned int clip) {
+	load_clip(clip);
+	ClipKeys const &pool = clip_keys.at(clip);
+	if (pool.animated_positions.empty()) {
+		throw std::runtime_error("clip " + std::to_string(clip) + " has no vertex animation");
+	}
+	vertex_animation_textures.resize(clips.size());
+	VertexAnimationTextures &textures = vertex_animation_textures[clip];
+	VertexAnimationInfo const &va = pool.vertex_animation;
+	GLenum internal_format = (va.type == GL_HALF_FLOAT ? GL_RGBA16F : GL_RGBA32F);
+	auto upload_texels = [&](GLuint *tex, std::vector< char > const &texels) {
+		if (*tex == 0) glGenTextures(1, tex);
+		glBindTexture(GL_TEXTURE_2D, *tex);
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, GLsizei(va.width), GLsizei(va.rows_per_frame * clips[clip].num_frames), 0, GL_RGBA, va.type, texels.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	};
+	upload_texels(&textures.positions, pool.animated_positions);
+	upload_texels(&textures.normals, pool.animated_normals);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void SkeletalAsset::bind_vertex_animation(unsigned int mesh, GLuint program, unsigned int clip, unsigned int frame) const {
+	if (!has_vertex_animation(clip)) {
+		throw std::runtime_error("clip " + std::to_string(clip) + " has no uploaded vertex animation");
+	}
+	VertexAnimationTextures const &textures = vertex_animation_textures[clip];
+	VertexAnimationInfo const &va = clip_keys[clip].vertex_animation;
+	glUseProgram(program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, textures.positions);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, textures.normals);
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i(glGetUniformLocation(program, "AnimatedPositions"), 0);
+	glUniform1i(glGetUniformLocation(program, "AnimatedNormals"), 1);
+	glUniform1i(glGetUniformLocation(program, "AnimationWidth"), GLint(va.width));
+	glUniform1i(glGetUniformLocation(program, "AnimationFirstRow"), GLint(std::min(frame, uint32_t(std::max(0, clips[clip].num_frames - 1))) * va.rows_per_frame));
+	glUniform1i(glGetUniformLocation(program, "AnimationOffset"), GLint(meshes.at(mesh).vertex_animation_offset));
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+/*
+ * A "SkeletalAsset" is the runtime side of the exporter: it loads the
+ *  meshes, node hierarchy, and animation channels from a .skel file
+ *  (see SkelFile.hpp) and evaluates poses without needing Assimp.
+ *
+ */
+
+#include "Skeletal.hpp"
+#include "SkelFile.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+struct SkeletalAsset {
+	//construct from a file:
+	// if 'stream_clips', only the table of contents, hierarchy and meshes are read now; each clip's
+	// keys are read from the file when the clip is first used (or by load_clip), and can be freed again.
+	// note: will throw if file fails to read.
+	SkeletalAsset(std::string const &filename, bool stream_clips = false);
+
+	struct MeshData {
+		//interleaved vertices, described by vertex_layout:
+		// (meshes exported as planar arrays are interleaved into SkinnedVertex on load)
+		std::vector< uint8_t > vertex_stream;
+		std::vector< VertexAttribute > vertex_layout;
+		uint32_t vertex_count = 0;
+		bool quantized_positions = false; //positions are unorm16x3, dequantized with 'quantization' ("vqnt" chunk)
+		VertexQuantization quantization;
+		bool oct_normals = false; //normals are octahedral snorm16x2
+		uint32_t influences = 0; //1, 2 or 4 compact (uint8 / unorm8) bone influences, or 0 for BoneID + BoneWeight
+		//indices are kept in the format they are uploaded in, so 16-bit meshes cost half the memory:
+		GLenum index_type = GL_UNSIGNED_INT; //GL_UNSIGNED_SHORT if exported as 16-bit ("ix16" chunk, or "zidx" with under 65536 vertices)
+		std::vector< unsigned int > indices; //GL_UNSIGNED_INT meshes only
+		std::vector< uint16_t > indices16; //GL_UNSIGNED_SHORT meshes only
+		size_t index_count() const { return index_type == GL_UNSIGNED_SHORT ? indices16.size() : indices.size(); }
+		std::vector< Bone > bones;
+		std::vector< uint32_t > bone_map; //the skeleton bone of each of 'bones' ("bmap" chunk)
+		//optional meshlets ("mshl" chunk) and the bones each depends on ("mlbn" chunk), for cull_meshlets:
+		// (the meshlet-local vertex / triangle lists, "mlvx" / "mltr", are for GPU-side consumers and aren't loaded)
+		std::vector< Meshlet > meshlets;
+		std::vector< uint32_t > meshlet_bones;
+		//optional simplified levels ("lods" chunk) and their indices ("lodi" chunk, in the mesh's index_type, like 'indices'):
+		std::vector< MeshLOD > lods;
+		std::vector< unsigned int > lod_indices;
+		std::vector< uint16_t > lod_indices16;
+		size_t lod_index_count() const { return index_type == GL_UNSIGNED_SHORT ? lod_indices16.size() : lod_indices.size(); }
+		//meshes with the same vertices + indices store them once ("gref" chunk) and share GPU buffers, even across assets:
+		uint64_t geometry_hash = 0; //hash of the geometry ("ghsh" chunk), or 0 for files from before it
+		int32_t geometry_source = -1; //earlier mesh of this asset whose geometry this mesh reuses, or -1
+		uint32_t palette_offset = 0; //this mesh's first entry in the palette's bone map (see palette_bone_map)
+		uint32_t vertex_animation_offset = 0; //this mesh's first vertex in each frame of a vertex animation texture
+	};
+	std::vector< MeshData > meshes;
+	uint32_t palette_size = 0; //skeleton bones: the bones in each frame of a baked palette
+	uint32_t palette_bone_map_size = 0; //bones of all meshes together: their bone maps, one after another
+	uint32_t total_vertices = 0; //vertices of all meshes together: the vertices in each frame of a vertex animation texture
+
+	//the hierarchy, as dense arrays indexed by node (parents always come before their children):
+	std::vector< int32_t > node_parents; //-1 for the root
+	std::vector< glm::mat4 > node_bind_transforms; //local transform of nodes the current clip doesn't animate
+	std::vector< glm::mat4 > overall_transforms; //scratch: each node's transform under the root, from update_nodes
+	std::vector< Socket > sockets; //named attachment nodes ("sock" chunk, optional)
+
+	//node of the socket with a given name, or -1 if there is none:
+	// (its overall_transforms entry, after update_nodes, is where things attached to it go)
+	int find_socket(std::string const &name) const;
+	std::vector< Animation > animations; //one entry per animated node per clip, grouped by clip
+	std::vector< Clip > clips; //name, length and channels of each clip (older files get one clip with every channel)
+
+	//key pools of one clip, shared by its channels; exactly one layout is loaded:
+	enum class KeyLayout { Mat4, TRS, Quantized } key_layout = KeyLayout::Mat4;
+	struct ClipKeys {
+		bool loaded = false;
+		std::vector< glm::mat4 > keys; //baked matrices ("keys" chunk)
+		std::vector< TRSKey > trs_keys; //rotation + translation ("trsk" chunk)...
+		std::vector< glm::vec3 > scale_keys; //...plus scale for channels that have it ("scal" chunk)
+		std::vector< PackedQuat > packed_rotations; //quantized rotation ("qrot" chunk)...
+		std::vector< QuantizedVec3 > packed_translations; //...translation ("qpos" chunk)...
+		std::vector< QuantizedVec3 > packed_scales; //...and scale ("qscl" chunk)...
+		std::vector< QuantizedRange > ranges; //...relative to per-channel ranges ("qrng" chunk)
+		std::vector< uint16_t > key_frames; //frame of each key, present only if keys were reduced ("kfrm" chunk)
+		std::vector< PaletteMatrix > palette; //optional: every skeleton bone's transform at every frame, num_frames x palette_size ("pall" chunk)
+		//optional: every mesh's skinned vertices at every frame, as texels ready to upload ("vati" + "vatp" / "vatn" chunks)
+		VertexAnimationInfo vertex_animation;
+		std::vector< char > animated_positions;
+		std::vector< char > animated_normals;
+	};
+	std::vector< ClipKeys > clip_keys; //per clip
+	std::vector< std::vector< int > > node_channels; //per clip: the channel animating each node, or -1
+
+	//index of the clip with a given name, or -1 if there is none:
+	int find_clip(std::string const &name) const;
+
+	//length of a clip in seconds, and the (fractional) frame of a clip at a time in seconds:
+	// channels are resampled to the clip's uniform sample_rate, so this is just seconds * sample_rate, clamped to the clip.
+	float clip_length(unsigned int clip) const;
+	float frame_at(unsigned int clip, float seconds) const;
+
+	//read a clip's keys ahead of time, so update_nodes doesn't have to mid-frame (streamed assets):
+	void load_clip(unsigned int clip);
+	//free a clip's keys; it is read again when next used (streamed assets; otherwise does nothing):
+	void unload_clip(unsigned int clip);
+
+	//compute every node's overall_transforms entry at a (possibly fractional) frame of a clip:
+	// (channels shorter than 'frame' hold their last key; nodes the clip doesn't animate keep their bind transform)
+	// TRS and quantized keys are interpolated (slerp + lerp); baked matrices use the nearest earlier key.
+	// several clips can be played from one asset by updating nodes + reading bone transforms for each in turn.
+	void update_nodes(unsigned int clip, float frame);
+
+	//keys of a channel that bracket 'frame' (relative to first_key), and how far between them it is:
+	void find_keys(ClipKeys const &pool, Animation const &animation, float frame, int *k0, int *k1, float *t) const;
+
+	//local transform of an animated node at a given frame (Mat4 and TRS layouts):
+	glm::mat4 sample(ClipKeys const &pool, Animation const &animation, float frame) const;
+
+	//unpack + interpolate one whole frame of the quantized layout, for all channels of a (loaded) clip at once:
+	// (indexed by channel - first_channel; scales[c] is left at 1 for channels without scale)
+	void decode_frame(unsigned int clip, float frame, std::vector< TRSKey > *keys, std::vector< glm::vec3 > *scales) const;
+
+	//scratch space for update_nodes with quantized keys:
+	std::vector< TRSKey > decoded_keys;
+	std::vector< glm::vec3 > decoded_scales;
+
+	//the file clips are streamed from (null unless constructed with 'stream_clips'):
+	std::unique_ptr< SkelFile > stream;
+	void read_clip_keys(SkelFile const &file, unsigned int clip);
+
+	//every distinct bone of all meshes, once ("skbn" chunk, or built on load for older files):
+	std::vector< Bone > skeleton;
+
+	//compute final bone transforms for a mesh from the current node transforms:
+	void get_bone_transforms(unsigned int mesh, std::vector< glm::mat4 > *bone_transforms) const;
+
+	//or, for several meshes: compute the whole skeleton's final transforms once per frame,
+	// then pick each mesh's bone transforms out of them (a copy per bone, no matrix math):
+	void get_skeleton_transforms(std::vector< glm::mat4 > *skeleton_transforms) const;
+	void get_bone_transforms(unsigned int mesh, std::vector< glm::mat4 > const &skeleton_transforms, std::vector< glm::mat4 > *bone_transforms) const;
+
+	//meshlets of 'mesh' that may be visible, given the current bone transforms (from get_bone_transforms):
+	// culls meshlets whose bounding sphere is outside the view frustum of 'world_to_clip',
+	// and (if 'cull_backfaces') meshlets whose triangles all face away from 'eye'.
+	// bind pose bounds are moved by every bone in the meshlet's bone set, so culling stays conservative under skinning.
+	void cull_meshlets(unsigned int mesh, std::vector< glm::mat4 > const &bone_transforms,
+		glm::mat4 const &world_to_clip, glm::vec3 const &eye, bool cull_backfaces, std::vector< uint32_t > *visible) const;
+
+	//level of detail to draw 'mesh' at from 'distance' away: 0 for the full mesh, or 1 + an index into its 'lods'
+	// picks the coarsest level whose error projects to at most 'max_pixel_error' pixels;
+	// 'pixels_per_unit' is the viewport height / (2 * tan(vertical fov / 2)), i.e. pixels per unit at distance 1.
+	unsigned int select_lod(unsigned int mesh, float distance, float pixels_per_unit, float max_pixel_error = 1.0f) const;
+
+	//-- OpenGL ---
+	//upload each mesh's vertex stream + indices and set up its vertex array object:
+	// (needs an OpenGL context; one buffer + one attribute setup per distinct geometry, shared by every asset that has it)
+	void upload();
+
+	//draw a mesh with 'program', which should be the skinning shader variant for the mesh's 'influences':
+	// (also sets the shader's QuantizedPositions / PositionMin / PositionExtent / OctNormals uniforms to decode the mesh's vertex encoding)
+	// if 'visible_meshlets' is given, only those meshlets are drawn (one multi-draw call);
+	// otherwise 'lod' (from select_lod) picks a simplified level. (meshlets only cover the full mesh)
+	// 'instances' > 1 draws the (LOD) geometry that many times in one call, for meshes set up with the instanced bind_palette.
+	void draw(unsigned int mesh, GLuint program, std::vector< glm::mat4 > const &bone_transforms,
+		std::vector< uint32_t > const *visible_meshlets = nullptr, unsigned int lod = 0, GLsizei instances = 1) const;
+
+	//whether a clip was exported with a baked palette ("pall" chunk) and it has been uploaded:
+	bool has_palette(unsigned int clip) const;
+
+	//upload a clip's baked palette as a texture (upload does this for every clip loaded at the time):
+	void upload_palette(unsigned int clip);
+
+	//set up 'program' (a BAKED_PALETTE skinning variant) to skin 'mesh' with frame 'frame' of a clip's baked palette;
+	// then draw with no bone transforms. this replaces update_nodes + get_bone_transforms entirely:
+	// nothing is sampled or traversed on the CPU, so the frame is rounded rather than interpolated.
+	void bind_palette(unsigned int mesh, GLuint program, unsigned int clip, unsigned int frame) const;
+	//instanced version: instance i is skinned with the bones of same_geometry[i], which must all share one mesh's geometry
+	// (that mesh plus the meshes whose geometry_source it is); draw any of them with instances = same_geometry.size().
+	static constexpr uint32_t MaxPaletteInstances = 16; //the size of the shader's PaletteOffsets array
+	void bind_palette(std::vector< unsigned int > const &same_geometry, GLuint program, unsigned int clip, unsigned int frame) const;
+
+	std::vector< GLuint > palette_textures; //per clip, 0 if none uploaded
+	GLuint palette_bone_map = 0; //every mesh's bone_map, concatenated (R32I, one row): palette columns of each mesh's bones
+
+	//vertex animation textures: the cheapest way to draw a clip, skinned entirely ahead of time --
+	// the VERTEX_ANIMATION shader reads each vertex's position + normal by gl_VertexID, with no bones at all.
+	bool has_vertex_animation(unsigned int clip) const;
+	void upload_vertex_animation(unsigned int clip); //(upload does this for every clip loaded at the time)
+	//set up 'program' to draw 'mesh' at frame 'frame' of a clip's vertex animation; then draw with no bone transforms:
+	void bind_vertex_animation(unsigned int mesh, GLuint program, unsigned int clip, unsigned int frame) const;
+
+	struct VertexAnimationTextures {
+		GLuint positions = 0;
+		GLuint normals = 0;
+	};
+	std::vector< VertexAnimationTextures > vertex_animation_textures; //per clip, 0s if none uploaded
+
+	struct GPUMesh {
+		GLuint vao = 0;
+		GLuint vertex_buffer = 0;
+		GLuint index_buffer = 0;
+		GLsizei elements = 0; //the full mesh's indices; LOD indices follow them in index_buffer
+		GLenum index_type = GL_UNSIGNED_INT;
+	};
+	std::vector< GPUMesh > gpu_meshes;
+};
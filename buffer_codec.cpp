@@ -0,0 +1,289 @@
+#include "buffer_codec.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+
+namespace {
+	constexpr uint32_t EdgeFifoSize = 15;
+	constexpr uint32_t VertexFifoSize = 14;
+	//triangle byte: shared edge age (0..14, NoEdge = none) in the high nibble, a vertex code in the low nibble;
+	//vertex codes: 0 = next unused vertex, 1..VertexFifoSize = recent vertex, DeltaCode = varint delta from the last vertex follows
+	constexpr uint8_t NoEdge = 15;
+	constexpr uint8_t DeltaCode = 15;
+
+	constexpr size_t GroupSize = 16; //vertex deltas per bit width
+	constexpr uint32_t GroupBits[4] = {0, 2, 4, 8};
+	constexpr size_t BlockSize = 256; //vertices coded together, plane by plane
+
+	void put_varint(std::vector< uint8_t > *out, uint32_t value) {
+		while (value >= 0x80) {
+			out->emplace_back(uint8_t(value | 0x80));
+			value >>= 7;
+		}
+		out->emplace_back(uint8_t(value));
+	}
+
+	uint32_t get_varint(uint8_t const *&at, uint8_t const *end) {
+		uint32_t value = 0;
+		for (uint32_t shift = 0; shift < 35; shift += 7) {
+			if (at == end) throw std::runtime_error("encoded buffer is truncated");
+			uint8_t byte = *at++;
+			value |= uint32_t(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) return value;
+		}
+		throw std::runtime_error("encoded buffer has an overlong varint");
+	}
+
+	uint32_t zigzag(int32_t value) {
+		return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+	}
+	int32_t unzigzag(uint32_t value) {
+		return int32_t(value >> 1) ^ -int32_t(value & 1);
+	}
+
+	//state both sides of the index codec keep in lockstep:
+	struct IndexState {
+		IndexState() {
+			for (auto &edge : edges) edge[0] = edge[1] = ~0u;
+			for (auto &vertex : vertices) vertex = ~0u;
+		}
+		uint32_t edges[EdgeFifoSize][2];
+		uint32_t edge_head = 0; //slot the next edge goes in
+		uint32_t vertices[VertexFifoSize];
+		uint32_t vertex_head = 0;
+		uint32_t next = 0; //lowest vertex not yet seen (in first-use order, usually the one a new vertex is)
+		uint32_t last = 0; //last vertex coded, for deltas
+
+		uint32_t const *edge(uint32_t age) const { return edges[(edge_head + EdgeFifoSize - 1 - age) % EdgeFifoSize]; }
+		uint32_t vertex(uint32_t age) const { return vertices[(vertex_head + VertexFifoSize - 1 - age) % VertexFifoSize]; }
+
+		//after a triangle (a, b, c): its edges, as a neighbor on the other side would walk them
+		void push_triangle(uint32_t a, uint32_t b, uint32_t c) {
+			uint32_t pairs[3][2] = {{b, a}, {c, b}, {a, c}};
+			for (auto const &pair : pairs) {
+				edges[edge_head][0] = pair[0];
+				edges[edge_head][1] = pair[1];
+				edge_head = (edge_head + 1) % EdgeFifoSize;
+			}
+		}
+		//after a vertex was coded with 'code':
+		void push_vertex(uint32_t v, uint32_t code) {
+			if (code == 0 || code == DeltaCode) {
+				vertices[vertex_head] = v;
+				vertex_head = (vertex_head + 1) % VertexFifoSize;
+			}
+			if (v == next) ++next;
+			last = v;
+		}
+	};
+
+	//code for a vertex (and the delta to write after the codes, if it is DeltaCode):
+	uint8_t encode_vertex(IndexState *state, uint32_t v, std::vector< uint32_t > *deltas) {
+		uint8_t code = 0;
+		if (v != state->next) {
+			code = DeltaCode;
+			for (uint32_t age = 0; age < VertexFifoSize; ++age) {
+				if (state->vertex(age) == v) {
+					code = uint8_t(1 + age);
+					break;
+				}
+			}
+			if (code == DeltaCode) deltas->emplace_back(zigzag(int32_t(v - state->last)));
+		}
+		state->push_vertex(v, code);
+		return code;
+	}
+
+	uint32_t decode_vertex(IndexState *state, uint8_t code, uint8_t const *&at, uint8_t const *end) {
+		uint32_t v;
+		if (code == 0) v = state->next;
+		else if (code != DeltaCode) v = state->vertex(code - 1u);
+		else v = state->last + uint32_t(unzigzag(get_varint(at, end)));
+		state->push_vertex(v, code);
+		return v;
+	}
+}
+
+std::vector< uint8_t > encode_index_buffer(std::vector< unsigned int > const &indices) {
+	assert(indices.size() % 3 == 0);
+	std::vector< uint8_t > out;
+	out.reserve(indices.size() / 2);
+	put_varint(&out, uint32_t(indices.size()));
+
+	IndexState state;
+	std::vector< uint32_t > deltas;
+	for (size_t t = 0; t + 3 <= indices.size(); t += 3) {
+		uint32_t tri[3] = {indices[t+0], indices[t+1], indices[t+2]};
+		//look for a recent edge this triangle shares, newest first:
+		uint32_t found_age = NoEdge;
+		uint32_t rotation = 0;
+		for (uint32_t age = 0; age < EdgeFifoSize && found_age == NoEdge; ++age) {
+			uint32_t const *edge = state.edge(age);
+			for (uint32_t r = 0; r < 3; ++r) {
+				if (tri[r] == edge[0] && tri[(r+1)%3] == edge[1]) {
+					found_age = age;
+					rotation = r;
+					break;
+				}
+			}
+		}
+		uint32_t a = tri[rotation], b = tri[(rotation+1)%3], c = tri[(rotation+2)%3];
+		deltas.clear();
+		if (found_age == NoEdge) {
+			//one more byte for the other two vertices' codes
+			uint8_t code_a = encode_vertex(&state, a, &deltas);
+			uint8_t code_b = encode_vertex(&state, b, &deltas);
+			uint8_t code_c = encode_vertex(&state, c, &deltas);
+			out.emplace_back(uint8_t((NoEdge << 4) | code_a));
+			out.emplace_back(uint8_t((code_b << 4) | code_c));
+		} else {
+			out.emplace_back(uint8_t((found_age << 4) | encode_vertex(&state, c, &deltas)));
+		}
+		for (auto delta : deltas) put_varint(&out, delta);
+		state.push_triangle(a, b, c);
+	}
+	return out;
+}
+
+std::vector< unsigned int > decode_index_buffer(std::vector< uint8_t > const &encoded) {
+	uint8_t const *at = encoded.data();
+	uint8_t const *end = at + encoded.size();
+	uint32_t count = get_varint(at, end);
+	if (count % 3 != 0 || count / 3 > size_t(end - at)) {
+		throw std::runtime_error("encoded index buffer has a bad count");
+	}
+	std::vector< unsigned int > indices(count);
+
+	IndexState state;
+	for (uint32_t t = 0; t < count; t += 3) {
+		if (at == end) throw std::runtime_error("encoded buffer is truncated");
+		uint8_t byte = *at++;
+		uint32_t a, b, c;
+		if ((byte >> 4) == NoEdge) {
+			if (at == end) throw std::runtime_error("encoded buffer is truncated");
+			uint8_t codes = *at++;
+			//(deltas follow in vertex order)
+			a = decode_vertex(&state, byte & 15, at, end);
+			b = decode_vertex(&state, codes >> 4, at, end);
+			c = decode_vertex(&state, codes & 15, at, end);
+		} else {
+			uint32_t const *edge = state.edge(byte >> 4);
+			a = edge[0];
+			b = edge[1];
+			c = decode_vertex(&state, byte & 15, at, end);
+		}
+		indices[t+0] = a;
+		indices[t+1] = b;
+		indices[t+2] = c;
+		state.push_triangle(a, b, c);
+	}
+	return indices;
+}
+
+std::vector< uint8_t > encode_vertex_buffer(uint8_t const *vertices, size_t count, size_t stride) {
+	std::vector< uint8_t > out;
+	put_varint(&out, uint32_t(count));
+	put_varint(&out, uint32_t(stride));
+
+	//blocks of BlockSize vertices, each holding every byte plane in turn, so the decoder works in cache:
+	std::vector< uint8_t > prev(stride, 0);
+	uint8_t deltas[BlockSize];
+	for (size_t first = 0; first < count; first += BlockSize) {
+		size_t n = std::min(BlockSize, count - first);
+		size_t groups = (n + GroupSize - 1) / GroupSize;
+		for (size_t k = 0; k < stride; ++k) {
+			//zigzagged byte deltas from the previous vertex:
+			std::memset(deltas, 0, sizeof(deltas));
+			for (size_t i = 0; i < n; ++i) {
+				uint8_t byte = vertices[(first + i) * stride + k];
+				uint8_t delta = uint8_t(byte - prev[k]);
+				deltas[i] = uint8_t((delta << 1) ^ uint8_t(int8_t(delta) >> 7));
+				prev[k] = byte;
+			}
+
+			//2 bit width selector per group, four to a byte, then the packed groups:
+			size_t header = out.size();
+			out.resize(out.size() + (groups + 3) / 4, 0);
+			for (size_t g = 0; g < groups; ++g) {
+				uint8_t const *group = &deltas[g * GroupSize];
+				uint8_t max = 0;
+				for (size_t j = 0; j < GroupSize; ++j) max |= group[j];
+				uint32_t selector = (max == 0 ? 0 : max < 4 ? 1 : max < 16 ? 2 : 3);
+				out[header + g / 4] |= uint8_t(selector << (2 * (g % 4)));
+				uint32_t bits = GroupBits[selector];
+				if (bits == 8) {
+					out.insert(out.end(), group, group + GroupSize);
+				} else if (bits != 0) {
+					uint32_t per_byte = 8 / bits;
+					for (size_t j = 0; j < GroupSize; j += per_byte) {
+						uint8_t byte = 0;
+						for (uint32_t b = 0; b < per_byte; ++b) byte |= uint8_t(group[j + b] << (b * bits));
+						out.emplace_back(byte);
+					}
+				}
+			}
+		}
+	}
+	return out;
+}
+
+void decode_vertex_buffer(std::vector< uint8_t > const &encoded, std::vector< uint8_t > *vertices_, size_t *stride_) {
+	assert(vertices_);
+	assert(stride_);
+	auto &vertices = *vertices_;
+	uint8_t const *at = encoded.data();
+	uint8_t const *end = at + encoded.size();
+	size_t count = get_varint(at, end);
+	size_t stride = get_varint(at, end);
+	//(every plane of every block needs at least one selector byte per 64 vertices, which bounds count * stride by the input size)
+	if (stride == 0 ? count != 0 : (count + 4 * GroupSize - 1) / (4 * GroupSize) > size_t(end - at) / stride) {
+		throw std::runtime_error("encoded vertex buffer has a bad size");
+	}
+	vertices.assign(count * stride, 0);
+	*stride_ = stride;
+
+	std::vector< uint8_t > prev(stride, 0);
+	uint8_t deltas[GroupSize];
+	for (size_t first = 0; first < count; first += BlockSize) {
+		size_t n = std::min(BlockSize, count - first);
+		size_t groups = (n + GroupSize - 1) / GroupSize;
+		for (size_t k = 0; k < stride; ++k) {
+			uint8_t const *header = at;
+			if (size_t(end - at) < (groups + 3) / 4) throw std::runtime_error("encoded buffer is truncated");
+			at += (groups + 3) / 4;
+			uint8_t value = prev[k];
+			for (size_t g = 0; g < groups; ++g) {
+				uint32_t bits = GroupBits[(header[g / 4] >> (2 * (g % 4))) & 3];
+				if (size_t(end - at) < GroupSize * bits / 8) throw std::runtime_error("encoded buffer is truncated");
+				if (bits == 0) {
+					std::memset(deltas, 0, GroupSize);
+				} else if (bits == 2) {
+					for (size_t j = 0; j < GroupSize / 4; ++j) {
+						deltas[4*j+0] = at[j] & 3;
+						deltas[4*j+1] = (at[j] >> 2) & 3;
+						deltas[4*j+2] = (at[j] >> 4) & 3;
+						deltas[4*j+3] = at[j] >> 6;
+					}
+				} else if (bits == 4) {
+					for (size_t j = 0; j < GroupSize / 2; ++j) {
+						deltas[2*j+0] = at[j] & 15;
+						deltas[2*j+1] = at[j] >> 4;
+					}
+				} else {
+					std::memcpy(deltas, at, GroupSize);
+				}
+				at += GroupSize * bits / 8;
+
+				uint8_t *out = vertices.data() + (first + g * GroupSize) * stride + k;
+				size_t m = std::min(GroupSize, n - g * GroupSize);
+				for (size_t j = 0; j < m; ++j) {
+					value = uint8_t(value + uint8_t((deltas[j] >> 1) ^ uint8_t(-(deltas[j] & 1))));
+					out[j * stride] = value;
+				}
+			}
+			prev[k] = value;
+		}
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+//Lossless compression for index and vertex buffers, in the spirit of meshoptimizer's codecs:
+// the exporter encodes ("-compress"), the runtime decodes on load. No dependencies, and both
+// formats are byte-oriented so decoding is a tight loop with no entropy coder.
+//
+//Indices (triangle lists): each triangle usually shares an edge with a recent triangle and has one
+// new vertex, usually the next unused one. So a triangle is mostly one byte: a shared edge in a FIFO of
+// recent edges (triangles are rotated to put that edge first; winding is kept) and a 4 bit code for the
+// third vertex: "next", an entry of a FIFO of recent vertices, or an escape to a varint delta.
+//
+//Vertices: the stream is split into byte planes (byte k of every vertex), each plane is delta coded
+// against the previous vertex, and the deltas are stored in groups of 16 at 0, 2, 4 or 8 bits each.
+// quantized / octahedral / uint8 attributes mostly change in their low bits, so most groups shrink.
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//encode a triangle list (indices.size() must be a multiple of 3):
+std::vector< uint8_t > encode_index_buffer(std::vector< unsigned int > const &indices);
+
+//decode an index buffer; triangles come back in the same order, each possibly rotated.
+// note: throws on malformed input.
+std::vector< unsigned int > decode_index_buffer(std::vector< uint8_t > const &encoded);
+
+//encode 'count' vertices of 'stride' bytes each:
+std::vector< uint8_t > encode_vertex_buffer(uint8_t const *vertices, size_t count, size_t stride);
+
+//decode a vertex buffer, writing its count * stride bytes to 'vertices' (and the stride to 'stride'):
+// note: throws on malformed input.
+void decode_vertex_buffer(std::vector< uint8_t > const &encoded, std::vector< uint8_t > *vertices, size_t *stride);
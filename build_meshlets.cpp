@@ -0,0 +1,121 @@
+#include "build_meshlets.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+	constexpr float Pi = 3.14159265358979f;
+
+	//bounding sphere, normal cone, and bone set of the triangles [begin, end):
+	void finish_meshlet(Meshlet *meshlet_, std::vector< unsigned int > const &indices, std::vector< float > const &positions,
+		std::vector< std::vector< BoneInfluence > > const &influences,
+		std::vector< uint32_t > const &meshlet_vertices, std::vector< uint32_t > *meshlet_bones_) {
+		auto &meshlet = *meshlet_;
+		auto &meshlet_bones = *meshlet_bones_;
+		auto position = [&positions](uint32_t v) {
+			return glm::vec3(positions[3*v+0], positions[3*v+1], positions[3*v+2]);
+		};
+
+		//sphere around the center of the bounding box:
+		glm::vec3 min(position(meshlet_vertices[meshlet.first_vertex]));
+		glm::vec3 max(min);
+		for (uint32_t i = 0; i < meshlet.vertex_count; ++i) {
+			glm::vec3 p = position(meshlet_vertices[meshlet.first_vertex + i]);
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+		meshlet.center = 0.5f * (min + max);
+		meshlet.radius = 0.0f;
+		for (uint32_t i = 0; i < meshlet.vertex_count; ++i) {
+			meshlet.radius = std::max(meshlet.radius, glm::length(position(meshlet_vertices[meshlet.first_vertex + i]) - meshlet.center));
+		}
+
+		//cone around the average face normal:
+		std::vector< glm::vec3 > normals;
+		glm::vec3 sum(0.0f);
+		for (uint32_t t = meshlet.first_triangle; t < meshlet.first_triangle + meshlet.triangle_count; ++t) {
+			glm::vec3 a = position(indices[3*t+0]), b = position(indices[3*t+1]), c = position(indices[3*t+2]);
+			glm::vec3 n = glm::cross(b - a, c - a);
+			float length = glm::length(n);
+			if (length == 0.0f) continue; //degenerate triangles can't be seen from any side
+			normals.emplace_back(n / length);
+			sum += normals.back();
+		}
+		float sum_length = glm::length(sum);
+		if (normals.empty() || sum_length < 1e-6f) {
+			meshlet.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+			meshlet.cone_angle = Pi; //normals point every which way: never backfacing
+		} else {
+			meshlet.cone_axis = sum / sum_length;
+			float min_dot = 1.0f;
+			for (auto const &n : normals) min_dot = std::min(min_dot, glm::dot(n, meshlet.cone_axis));
+			meshlet.cone_angle = std::acos(std::max(-1.0f, std::min(1.0f, min_dot)));
+		}
+
+		//bones with any weight on any vertex:
+		meshlet.first_bone = uint32_t(meshlet_bones.size());
+		for (uint32_t i = 0; i < meshlet.vertex_count; ++i) {
+			for (auto const &influence : influences[meshlet_vertices[meshlet.first_vertex + i]]) {
+				meshlet_bones.emplace_back(influence.bone);
+			}
+		}
+		std::sort(meshlet_bones.begin() + meshlet.first_bone, meshlet_bones.end());
+		meshlet_bones.erase(std::unique(meshlet_bones.begin() + meshlet.first_bone, meshlet_bones.end()), meshlet_bones.end());
+		meshlet.bone_count = uint32_t(meshlet_bones.size() - meshlet.first_bone);
+	}
+}
+
+void build_meshlets(std::vector< unsigned int > const &indices, std::vector< float > const &positions,
+	std::vector< std::vector< BoneInfluence > > const &influences,
+	std::vector< Meshlet > *meshlets_, std::vector< uint32_t > *meshlet_vertices_,
+	std::vector< uint8_t > *meshlet_triangles_, std::vector< uint32_t > *meshlet_bones_,
+	size_t max_vertices, size_t max_triangles) {
+	assert(meshlets_ && meshlet_vertices_ && meshlet_triangles_ && meshlet_bones_);
+	assert(max_vertices >= 3 && max_vertices <= 256 && max_triangles >= 1);
+	auto &meshlets = *meshlets_;
+	auto &meshlet_vertices = *meshlet_vertices_;
+	auto &meshlet_triangles = *meshlet_triangles_;
+	meshlets.clear();
+	meshlet_vertices.clear();
+	meshlet_triangles.clear();
+	meshlet_bones_->clear();
+
+	size_t vertex_count = positions.size() / 3;
+	std::vector< uint32_t > local(vertex_count, ~0u); //vertex -> index within the current meshlet
+	Meshlet current;
+	auto start = [&](uint32_t first_triangle) {
+		current = Meshlet();
+		current.first_triangle = first_triangle;
+		current.first_vertex = uint32_t(meshlet_vertices.size());
+	};
+	auto finish = [&]() {
+		for (uint32_t i = 0; i < current.vertex_count; ++i) local[meshlet_vertices[current.first_vertex + i]] = ~0u;
+		finish_meshlet(&current, indices, positions, influences, meshlet_vertices, meshlet_bones_);
+		meshlets.emplace_back(current);
+	};
+
+	size_t triangle_count = indices.size() / 3;
+	start(0);
+	for (size_t t = 0; t < triangle_count; ++t) {
+		uint32_t new_vertices = 0;
+		for (size_t c = 0; c < 3; ++c) {
+			assert(indices[3*t+c] < vertex_count);
+			if (local[indices[3*t+c]] == ~0u) ++new_vertices;
+		}
+		if (current.vertex_count + new_vertices > max_vertices || current.triangle_count + 1 > max_triangles) {
+			finish();
+			start(uint32_t(t));
+		}
+		for (size_t c = 0; c < 3; ++c) {
+			uint32_t v = indices[3*t+c];
+			if (local[v] == ~0u) {
+				local[v] = current.vertex_count++;
+				meshlet_vertices.emplace_back(v);
+			}
+			meshlet_triangles.emplace_back(uint8_t(local[v]));
+		}
+		++current.triangle_count;
+	}
+	if (current.triangle_count > 0) finish();
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Skeletal.hpp"
+#include "limit_influences.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//meshlet size limits (a common sweet spot for both CPU culling and mesh shaders):
+constexpr size_t MeshletMaxVertices = 64;
+constexpr size_t MeshletMaxTriangles = 124;
+
+//Split a triangle list into meshlets and compute their culling bounds.
+//
+// triangles are taken in index buffer order -- each meshlet is the longest run that fits the limits --
+// so the index buffer needs no reordering, and running optimize_vertex_cache first gives compact meshlets.
+//
+// positions - three floats per vertex
+// influences - bone influences per vertex (after limit_influences); used to build each meshlet's bone set
+// meshlet_vertices, meshlet_triangles, meshlet_bones - receive the "mlvx", "mltr", "mlbn" arrays Meshlet refers to
+void build_meshlets(std::vector< unsigned int > const &indices, std::vector< float > const &positions,
+	std::vector< std::vector< BoneInfluence > > const &influences,
+	std::vector< Meshlet > *meshlets, std::vector< uint32_t > *meshlet_vertices,
+	std::vector< uint8_t > *meshlet_triangles, std::vector< uint32_t > *meshlet_bones,
+	size_t max_vertices = MeshletMaxVertices, size_t max_triangles = MeshletMaxTriangles);
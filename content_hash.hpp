@@ -0,0 +1,63 @@
+#pragma once
+
+//Fast non-cryptographic 64-bit hashing of byte streams (MurmurHash64A's mixing, fed incrementally).
+// used by the exporter to tell whether a source asset / mesh / set of options changed since the last export.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+struct ContentHash {
+	static constexpr uint64_t M = 0xc6a4a7935bd1e995ull;
+	static constexpr int R = 47;
+
+	uint64_t state;
+	uint64_t length = 0;
+
+	ContentHash(uint64_t seed = 0) : state(seed ^ 0x9e3779b97f4a7c15ull) { }
+
+	//note: the result depends on how data is split between calls, not only on the bytes themselves:
+	void add(void const *data_, size_t size) {
+		auto data = reinterpret_cast< uint8_t const * >(data_);
+		size_t blocks = size / 8;
+		for (size_t b = 0; b < blocks; ++b) {
+			uint64_t k;
+			std::memcpy(&k, data + 8 * b, 8);
+			k *= M;
+			k ^= k >> R;
+			k *= M;
+			state ^= k;
+			state *= M;
+		}
+		uint64_t tail = 0;
+		size_t remaining = size - 8 * blocks;
+		std::memcpy(&tail, data + 8 * blocks, remaining);
+		state ^= tail ^ (uint64_t(remaining) << 56);
+		state *= M;
+		length += size;
+	}
+
+	template< typename T >
+	void add(T const &value) {
+		add(&value, sizeof(T));
+	}
+	template< typename T >
+	void add(std::vector< T > const &values) {
+		add(values.size());
+		if (!values.empty()) add(values.data(), values.size() * sizeof(T));
+	}
+	void add(std::string const &value) {
+		add(value.size());
+		add(value.data(), value.size());
+	}
+
+	uint64_t finish() const {
+		uint64_t h = state ^ (length * M);
+		h ^= h >> R;
+		h *= M;
+		h ^= h >> R;
+		return h;
+	}
+};
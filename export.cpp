@@ -1,8 +1,39 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/ProgressHandler.hpp>
+#include <assimp/DefaultLogger.hpp>
+#include <assimp/LogStream.hpp>
 
 #include "Skeletal.hpp"
+#include "SkelFile.hpp"
+#include "reduce_keys.hpp"
+#include "optimize_indices.hpp"
+#include "limit_influences.hpp"
+#include "build_meshlets.hpp"
+#include "simplify_mesh.hpp"
+#include "buffer_codec.hpp"
+#include "import_presets.hpp"
+
+#include "parallel_for.hpp"
+#include "list_directory.hpp"
+#include "synthetic_rig.hpp"
+#include "self_test.hpp"
+#include "content_hash.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cmath>
+#include <sstream>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <stdexcept>
+#include <memory>
 
 // TIL this works in the opposite order
 glm::mat4 aiMatrix4x4ToGlm(const aiMatrix4x4 &from) {
@@ -27,38 +58,1011 @@ glm::mat4 aiMatrix4x4ToGlm(const aiMatrix4x4 &from) {
     return to;
 }
 
-int main(int argc, char** argv) {
-    Assimp::Importer importer;
+struct ExportOptions {
+    // layout of animation keys:
+    //  Mat4 - baked matrices ("keys" chunk)
+    //  TRS - rotation/translation/scale ("trsk"/"scal" chunks)
+    //  Quantized - 48 bit rotations, 16 bit translation/scale ("qrot"/"qpos"/"qscl"/"qrng" chunks)
+    enum class KeyLayout { Mat4, TRS, Quantized } key_layout = KeyLayout::TRS;
+    // drop keys that interpolation reproduces within this distance (0 = keep every key; TRS / Quantized only)
+    float max_key_error = 0.f;
+    // keys per second: every channel is resampled from its keys' times to this rate
+    float sample_rate = 30.f;
+    // write each mesh's vertices as one interleaved stream ("strm" + "vfmt" chunks) instead of planar arrays
+    bool interleave = false;
+    // compact position / normal / bone influence encodings for the interleaved stream (any of them implies interleave)
+    VertexEncoding vertex_encoding;
+    // reorder triangles for the post-transform vertex cache, optionally also sorting clusters to reduce overdraw
+    bool optimize_vertex_cache = false;
+    bool optimize_overdraw = false;
+    // ...splitting clusters where their ACMR drops below this x the mesh's (see optimize_vertex_cache)
+    float overdraw_split = 1.05f;
+    // split each mesh into meshlets with culling bounds ("mshl" + "mlvx"/"mltr"/"mlbn" chunks)
+    bool meshlets = false;
+    // bake every clip's final bone matrices for every frame ("pall" chunk per clip), for playback without the hierarchy
+    bool bake_palette = false;
+    // bake every clip into a vertex animation texture ("vati" + "vatp"/"vatn" chunks per clip): GL_FLOAT, GL_HALF_FLOAT or 0 for none
+    uint32_t vertex_animation = 0;
+    // compress index buffers and the interleaved vertex stream ("zidx" / "zlod" / "zstr" instead of "ix16" or "indi" / "lodi" / "strm")
+    bool compress = false;
+    // simplified levels of detail, as decreasing fractions of each mesh's triangles ("lods" + "lodi" chunks)
+    std::vector<float> lod_ratios;
+    // Assimp post-process steps run on import (see import_presets.hpp)
+    unsigned int import_steps = ImportSkinnedMinimal;
+    // drop nodes no bone or socket depends on, and fold static chains into their children (see prune_nodes)
+    bool prune_nodes = false;
+    // nodes to export as attachment points ("sock" chunk), by name
+    std::vector<std::string> sockets;
+};
 
-    const aiScene* scene = importer.ReadFile(data_path("bastionik.dae"),
-        aiProcess_CalcTangentSpace       |
-        aiProcess_Triangulate            |
-        aiProcess_JoinIdenticalVertices  |
-        aiProcess_SortByPType);
+// bump whenever the exporter writes something different for the same input + options, so stale outputs aren't reused
+constexpr uint32_t ExportCacheVersion = 6;
 
-    if (scene == nullptr) {
-        std::cerr << "Could not load asset.\n";
-        return -1;
+// widest vertex animation texture row; frames with more vertices wrap onto several rows
+constexpr uint32_t VertexAnimationMaxWidth = 8192;
+
+// hash of everything in ExportOptions that affects the output (extend this when adding options)
+uint64_t hash_options(const ExportOptions& options) {
+    ContentHash hash;
+    hash.add(ExportCacheVersion);
+    hash.add(uint32_t(options.key_layout));
+    hash.add(options.max_key_error);
+    hash.add(options.sample_rate);
+    hash.add(options.interleave);
+    hash.add(options.vertex_encoding.quantized_positions);
+    hash.add(options.vertex_encoding.oct_normals);
+    hash.add(options.vertex_encoding.influences);
+    hash.add(options.optimize_vertex_cache);
+    hash.add(options.optimize_overdraw);
+    hash.add(options.overdraw_split);
+    hash.add(options.meshlets);
+    hash.add(options.lod_ratios);
+    hash.add(options.bake_palette);
+    hash.add(options.vertex_animation);
+    hash.add(options.compress);
+    hash.add(options.import_steps);
+    hash.add(options.prune_nodes);
+    hash.add(options.sockets.size());
+    for (const auto& socket : options.sockets) {
+        hash.add(socket);
     }
+    return hash.finish();
+}
 
-    std::vector<std::string> level_order_node_names;
-    std::vector<Node> nodes;
+// incremental export bookkeeping, stored in the .skel itself (the game ignores these chunks):
+//  "srch" - ExportStamp: the source file + options the whole file was built from
+//  "mhsh" + mesh index - hash of that mesh's source data + options (see hash_mesh)
+//  "mchk" + mesh index - magics of the chunks that belong to that mesh, four chars each
+struct ExportStamp {
+    uint64_t source_hash;
+    uint64_t options_hash;
+};
+static_assert(sizeof(ExportStamp) == 16, "ExportStamp is packed");
 
-    auto find_idx = [](const std::vector<std::string>& vec, const std::string& e) -> int {
-        auto it = std::find(vec.begin(), vec.end(), e);
-        if (it != vec.end()) {
-            return std::distance(vec.begin(), it);
+// the previous export of an asset, to reuse the meshes whose source didn't change
+struct PreviousExport {
+    std::unique_ptr<SkelFile> file;
+    bool has_stamp = false;
+    ExportStamp stamp;
+    std::unordered_map<uint64_t, uint32_t> mesh_by_hash;
+};
+
+// cache hit / miss counts over a whole batch
+struct CacheStats {
+    std::atomic<size_t> asset_hits{0}, asset_misses{0};
+    std::atomic<size_t> mesh_hits{0}, mesh_misses{0};
+};
+
+// time spent in each import step, summed over a whole batch
+struct ImportTimes {
+    std::mutex mutex;
+    std::vector<std::pair<std::string, float>> steps; // in the order steps first ran
+    void add(const std::string& step, float seconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = std::find_if(steps.begin(), steps.end(), [&](const std::pair<std::string, float>& s) { return s.first == step; });
+        if (found == steps.end()) {
+            steps.emplace_back(step, seconds);
+        } else {
+            found->second += seconds;
         }
-        else {
-            return -1;
+    }
+};
+
+// times one import, step by step: Assimp tells the importer's progress handler as each post-process step starts,
+//  and the steps that run log "<Step> begin", which names them. (reading + parsing the file is the first "step")
+struct ImportTimer : Assimp::ProgressHandler {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point step_start = Clock::now();
+    std::string step_name = "read file";
+    std::vector<std::pair<std::string, float>> steps;
+
+    bool Update(float) override { return true; }
+    void UpdatePostProcess(int, int) override {
+        auto now = Clock::now();
+        float seconds = std::chrono::duration<float>(now - step_start).count();
+        if (!step_name.empty()) {
+            steps.emplace_back(step_name, seconds);
+        } else if (seconds > 0.f) {
+            // a step that logged no name (or a logger that dropped it): keep its time rather than lose it.
+            // (steps the flags didn't ask for are reported here too, but take next to no time)
+            auto unnamed = std::find_if(steps.begin(), steps.end(),
+                                        [](const std::pair<std::string, float>& step) { return step.first == "unnamed steps"; });
+            if (unnamed == steps.end()) {
+                steps.emplace_back("unnamed steps", seconds);
+            } else {
+                unnamed->second += seconds;
+            }
+        }
+        step_name.clear();
+        step_start = now;
+    }
+    void on_log(const char* message) {
+        // e.g. "Debug, T0: TriangulateProcess begin"
+        const char* begin = std::strstr(message, " begin");
+        if (!begin) return;
+        const char* name = begin;
+        while (name > message && name[-1] != ' ') name--;
+        step_name = std::string(name, begin);
+    }
+};
+
+// Assimp's DefaultLogger is global and logs from whichever thread is importing, so each thread's messages go to
+//  the timer of the import running on it
+thread_local ImportTimer* active_import_timer = nullptr;
+struct ImportTimerLogStream : Assimp::LogStream {
+    void write(const char* message) override {
+        if (active_import_timer) active_import_timer->on_log(message);
+    }
+};
+
+QuantizedVec3 quantize_vec3(const glm::vec3& v, const glm::vec3& min, const glm::vec3& extent) {
+    QuantizedVec3 q;
+    for (int c = 0; c < 3; c++) {
+        q.v[c] = quantize_unorm16(v[c], min[c], extent[c]);
+    }
+    return q;
+}
+
+// range a channel's quantized translations / scales are stored relative to: the bounds of all of its keys
+//  (taken before key reduction, so reduce_keys can measure error on keys exactly as they will be decoded)
+QuantizedRange key_range(const std::vector<TRSKey>& keys, const std::vector<glm::vec3>& scales) {
+    QuantizedRange range;
+    glm::vec3 min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max());
+    for (const auto& key : keys) {
+        min = glm::min(min, key.translation);
+        max = glm::max(max, key.translation);
+    }
+    range.translation_min = min;
+    range.translation_extent = max - min;
+
+    range.scale_min = glm::vec3(1.f);
+    range.scale_extent = glm::vec3(0.f);
+    if (!scales.empty()) {
+        min = glm::vec3(std::numeric_limits<float>::max());
+        max = glm::vec3(-std::numeric_limits<float>::max());
+        for (const auto& scale : scales) {
+            min = glm::min(min, scale);
+            max = glm::max(max, scale);
+        }
+        range.scale_min = min;
+        range.scale_extent = max - min;
+    }
+    return range;
+}
+
+// node name -> level order index, built once per scene and shared by every pass
+//  (if names repeat, the first node in level order wins)
+typedef std::unordered_map<std::string, int> NodeIndex;
+
+int find_node(const NodeIndex& node_index, const std::string& name) {
+    auto found = node_index.find(name);
+    if (found == node_index.end()) {
+        throw std::runtime_error("no node named '" + name + "'");
+    }
+    return found->second;
+}
+
+// hash everything export_mesh reads from a mesh, plus the options it is exported with
+uint64_t hash_mesh(const aiMesh* mesh, const NodeIndex& node_index, uint64_t options_hash) {
+    ContentHash hash(options_hash);
+    hash.add(mesh->mNumVertices);
+    hash.add(mesh->mVertices, sizeof(aiVector3D) * mesh->mNumVertices);
+    hash.add(mesh->mNormals, sizeof(aiVector3D) * mesh->mNumVertices);
+    hash.add(mesh->mNumFaces);
+    for (unsigned int face_idx = 0; face_idx < mesh->mNumFaces; face_idx++) {
+        const auto& face = mesh->mFaces[face_idx];
+        hash.add(face.mNumIndices);
+        hash.add(face.mIndices, sizeof(unsigned int) * face.mNumIndices);
+    }
+    hash.add(mesh->mNumBones);
+    for (unsigned int bone_idx = 0; bone_idx < mesh->mNumBones; bone_idx++) {
+        const auto bone = mesh->mBones[bone_idx];
+        hash.add(find_node(node_index, std::string(bone->mName.data))); // the node a bone resolves to is part of the output
+        hash.add(bone->mOffsetMatrix);
+        hash.add(bone->mNumWeights);
+        hash.add(bone->mWeights, sizeof(aiVertexWeight) * bone->mNumWeights);
+    }
+    return hash.finish();
+}
+
+// read 'filename' if it is a .skel written by this exporter; nullptr if it is missing or unreadable
+std::unique_ptr<PreviousExport> load_previous_export(const std::string& filename) {
+    if (!std::ifstream(filename)) return nullptr;
+    std::unique_ptr<PreviousExport> previous(new PreviousExport);
+    try {
+        previous->file.reset(new SkelFile(filename));
+        if (previous->file->find("srch")) {
+            auto stamp = previous->file->read<ExportStamp>("srch");
+            if (stamp.size() == 1) {
+                previous->has_stamp = true;
+                previous->stamp = stamp[0];
+            }
+        }
+        for (const auto& entry : previous->file->entries) {
+            if (std::string(entry.magic, 4) != "mhsh") continue;
+            auto hash = previous->file->read<uint64_t>("mhsh", entry.index);
+            if (hash.size() == 1) previous->mesh_by_hash.emplace(hash[0], entry.index);
+        }
+    } catch (std::exception&) {
+        return nullptr; // e.g. an older or damaged file: just export from scratch
+    }
+    return previous;
+}
+
+// copy the chunks of a previously exported mesh with the same hash into 'skel' as mesh 'mesh_idx'
+bool reuse_mesh(const PreviousExport& previous, uint64_t hash, unsigned int mesh_idx, SkelWriter* skel) {
+    auto found = previous.mesh_by_hash.find(hash);
+    if (found == previous.mesh_by_hash.end() || !previous.file->find("mchk", found->second)) return false;
+    auto magics = previous.file->read<char>("mchk", found->second);
+    SkelWriter reused;
+    for (size_t i = 0; i + 4 <= magics.size(); i += 4) {
+        std::string magic(&magics[i], 4);
+        const SkelEntry* entry = previous.file->find(magic, found->second);
+        if (!entry) return false;
+        reused.add(magic, mesh_idx, previous.file->read<char>(magic, found->second), entry->alignment);
+    }
+    *skel = std::move(reused);
+    return true;
+}
+
+// meshes whose chunks are byte-identical apart from their bones (repeated props, mirrored duplicates merged
+//  by the artist, ...) store that geometry once, and the game uploads it once:
+//  "ghsh" + mesh index - hash of the mesh's geometry chunks (the game shares GPU buffers between assets by it)
+//  "gref" + mesh index - the earlier mesh whose geometry this one uses; it then has only its "bone" chunk
+bool is_geometry_chunk(const SkelWriter::Chunk& chunk) {
+    return std::string(chunk.entry.magic, 4) != "bone";
+}
+
+uint64_t hash_geometry(const SkelWriter& mesh) {
+    ContentHash hash;
+    for (const auto& chunk : mesh.chunks) {
+        hash.add(chunk.entry.magic, 4);
+        hash.add(chunk.entry.alignment);
+        hash.add(chunk.entry.size);
+        if (is_geometry_chunk(chunk) && !chunk.data.empty()) hash.add(chunk.data.data(), chunk.data.size());
+    }
+    return hash.finish();
+}
+
+// (bone chunks only have to be the same size: meshes sharing geometry index the same number of bones)
+bool same_geometry(const SkelWriter& a, const SkelWriter& b) {
+    if (a.chunks.size() != b.chunks.size()) return false;
+    for (size_t i = 0; i < a.chunks.size(); i++) {
+        const auto& x = a.chunks[i];
+        const auto& y = b.chunks[i];
+        if (std::memcmp(x.entry.magic, y.entry.magic, 4) != 0 || x.entry.alignment != y.entry.alignment
+            || x.data.size() != y.data.size()) return false;
+        if (is_geometry_chunk(x) && x.data != y.data) return false;
+    }
+    return true;
+}
+
+// export one mesh of a scene into its own chunk list (the meshes of a scene are exported concurrently)
+void export_mesh(const aiMesh* mesh, unsigned int mesh_idx, const ExportOptions& options,
+                 const NodeIndex& node_index, SkelWriter* skel_, std::ostream& log) {
+    auto& skel = *skel_;
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<unsigned int> indices;
+    std::vector<BoneWeight> bone_weights;
+    std::vector<BoneID> bone_ids;
+    std::vector<std::vector<BoneInfluence>> influences;
+    std::vector<Bone> bones;
+
+    for (unsigned int vert_idx = 0; vert_idx < mesh->mNumVertices; vert_idx++) {
+        vertices.push_back(mesh->mVertices[vert_idx].x);
+        vertices.push_back(mesh->mVertices[vert_idx].y);
+        vertices.push_back(mesh->mVertices[vert_idx].z);
+        bone_weights.emplace_back();
+        bone_ids.emplace_back();
+        influences.emplace_back();
+    }
+
+    for (unsigned int vert_idx = 0; vert_idx < mesh->mNumVertices; vert_idx++) {
+        normals.push_back(mesh->mNormals[vert_idx].x);
+        normals.push_back(mesh->mNormals[vert_idx].y);
+        normals.push_back(mesh->mNormals[vert_idx].z);
+    }
+
+    for (unsigned int face_idx = 0; face_idx < mesh->mNumFaces; face_idx++) {
+        const auto& face = mesh->mFaces[face_idx];
+        for (unsigned int idx_idx = 0; idx_idx < face.mNumIndices; idx_idx++) {
+            indices.push_back(face.mIndices[idx_idx]);
+        }
+    }
+
+    for (auto bone_idx = 0u; bone_idx < mesh->mNumBones; bone_idx++) {
+        auto bone = mesh->mBones[bone_idx];
+        auto node_idx = find_node(node_index, std::string(bone->mName.data));
+        bones.emplace_back(node_idx, aiMatrix4x4ToGlm(bone->mOffsetMatrix));
+        log << bone->mName.data << ", " << bone->mNumWeights << std::endl;
+
+		    for (unsigned int weight_idx = 0; weight_idx < bone->mNumWeights; weight_idx++) {
+            const auto& weight = bone->mWeights[weight_idx];
+            influences.at(weight.mVertexId).push_back({bone_idx, weight.mWeight});
+        }
+	    }
+
+    // keep each vertex's strongest influences (at most four fit in BoneWeight / BoneID),
+    //  and with compact influences also pick the smallest count that covers this mesh
+    VertexEncoding encoding = options.vertex_encoding;
+    uint32_t max_influences = (encoding.influences > 0 ? encoding.influences : 4);
+    float min_weight = (encoding.influences > 0 ? 0.5f / 255.0f : 0.0f); // weights that would quantize to zero
+    uint32_t used_influences = limit_influences(&influences, max_influences, min_weight);
+    if (encoding.influences > 0) {
+        if (mesh->mNumBones > 256) {
+            log << "Mesh " << mesh_idx << ": more than 256 bones, keeping 32 bit influences" << std::endl;
+            encoding.influences = 0;
+        } else {
+            encoding.influences = (used_influences <= 1 ? 1 : used_influences <= 2 ? 2 : 4);
+            log << "Mesh " << mesh_idx << ": " << encoding.influences << " influence(s) per vertex" << std::endl;
+        }
+    }
+    for (unsigned int vert_idx = 0; vert_idx < mesh->mNumVertices; vert_idx++) {
+        for (const auto& influence : influences[vert_idx]) {
+            bone_weights[vert_idx].insert(influence.weight);
+            bone_ids[vert_idx].insert(int(influence.bone));
+        }
+    }
+
+    size_t vertex_count = mesh->mNumVertices;
+    std::vector<uint32_t> source_vertices(vertex_count); // which of the imported vertices each output vertex is
+    for (size_t vert_idx = 0; vert_idx < vertex_count; vert_idx++) {
+        source_vertices[vert_idx] = uint32_t(vert_idx);
+    }
+    if (options.optimize_vertex_cache && indices.size() == 3 * mesh->mNumFaces) {
+        float acmr_before = compute_acmr(indices, vertex_count);
+        float atvr_before = compute_atvr(indices, vertex_count);
+
+        std::vector<size_t> clusters;
+        optimize_vertex_cache(&indices, vertex_count, VertexCacheSize, &clusters, options.overdraw_split);
+        if (options.optimize_overdraw) {
+            optimize_overdraw(&indices, vertices, clusters);
+            log << "Mesh " << mesh_idx << ": " << clusters.size() << " overdraw clusters" << std::endl;
+        }
+
+        log << "Mesh " << mesh_idx << ": ACMR " << acmr_before << " -> " << compute_acmr(indices, vertex_count)
+                  << ", ATVR " << atvr_before << " -> " << compute_atvr(indices, vertex_count)
+                  << " (cache size " << VertexCacheSize << ")" << std::endl;
+
+        // then renumber vertices in first-use order so fetch streams through the vertex buffer
+        auto remap = optimize_vertex_fetch(&indices, vertex_count, &vertex_count);
+        remap_vertices(&vertices, remap, vertex_count, 3);
+        remap_vertices(&normals, remap, vertex_count, 3);
+        remap_vertices(&bone_weights, remap, vertex_count);
+        remap_vertices(&bone_ids, remap, vertex_count);
+        remap_vertices(&influences, remap, vertex_count);
+        remap_vertices(&source_vertices, remap, vertex_count);
+    }
+    if (options.vertex_animation) {
+        // so clips can be baked per output vertex after the mesh is done (see bake_vertex_animation)
+        skel.add("vsrc", mesh_idx, source_vertices);
+    }
+
+    if (options.meshlets && indices.size() == 3 * mesh->mNumFaces) {
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> meshlet_vertices;
+        std::vector<uint8_t> meshlet_triangles;
+        std::vector<uint32_t> meshlet_bones;
+        build_meshlets(indices, vertices, influences, &meshlets, &meshlet_vertices, &meshlet_triangles, &meshlet_bones);
+        skel.add("mshl", mesh_idx, meshlets);
+        skel.add("mlvx", mesh_idx, meshlet_vertices);
+        skel.add("mltr", mesh_idx, meshlet_triangles);
+        skel.add("mlbn", mesh_idx, meshlet_bones);
+        if (!meshlets.empty()) {
+            log << "Mesh " << mesh_idx << ": " << meshlets.size() << " meshlets, "
+                << float(meshlet_vertices.size()) / meshlets.size() << " vertices / "
+                << float(indices.size() / 3) / meshlets.size() << " triangles / "
+                << float(meshlet_bones.size()) / meshlets.size() << " bones each on average" << std::endl;
+        }
+    }
+
+    std::vector<MeshLOD> lods;
+    std::vector<unsigned int> lod_indices;
+    if (!options.lod_ratios.empty() && indices.size() == 3 * mesh->mNumFaces && vertex_count > 0) {
+        // a complete change of bone weights costs as much as moving a vertex by a tenth of the mesh's size,
+        //  so levels keep their vertices around joints until everything else is gone
+        glm::vec3 min(std::numeric_limits<float>::max());
+        glm::vec3 max(-std::numeric_limits<float>::max());
+        for (size_t vert_idx = 0; vert_idx < vertex_count; vert_idx++) {
+            glm::vec3 position(vertices[3 * vert_idx], vertices[3 * vert_idx + 1], vertices[3 * vert_idx + 2]);
+            min = glm::min(min, position);
+            max = glm::max(max, position);
+        }
+        float weight_error_scale = 0.1f * glm::length(max - min);
+
+        std::vector<std::vector<unsigned int>> levels;
+        std::vector<float> errors;
+        simplify_lods(indices, vertices, influences, options.lod_ratios, weight_error_scale, &levels, &errors);
+        for (size_t level = 0; level < levels.size(); level++) {
+            if (options.optimize_vertex_cache) {
+                optimize_vertex_cache(&levels[level], vertex_count);
+            }
+            MeshLOD lod;
+            lod.first_index = uint32_t(lod_indices.size());
+            lod.index_count = uint32_t(levels[level].size());
+            lod.error = errors[level];
+            lod.triangle_ratio = float(levels[level].size()) / float(indices.size());
+            lods.emplace_back(lod);
+            lod_indices.insert(lod_indices.end(), levels[level].begin(), levels[level].end());
+            log << "Mesh " << mesh_idx << ": LOD " << (level + 1) << " has " << levels[level].size() / 3
+                << " triangles (" << 100.f * lod.triangle_ratio << "%), error " << lod.error << std::endl;
+        }
+        if (levels.size() < options.lod_ratios.size()) {
+            log << "Mesh " << mesh_idx << ": could only simplify to " << levels.size() << " of "
+                << options.lod_ratios.size() << " LODs (seams, borders or skinning)" << std::endl;
+        }
+        if (!lods.empty()) {
+            skel.add("lods", mesh_idx, lods);
+        }
+    }
+
+    if (options.compress) {
+        // the runtime decodes to 16 bit indices when vertex_count < 65536, as if this were "ix16"
+        auto compressed = encode_index_buffer(indices);
+        skel.add("zidx", mesh_idx, compressed);
+        size_t raw_size = indices.size() * (vertex_count < 65536 ? sizeof(uint16_t) : sizeof(uint32_t));
+        log << "Mesh " << mesh_idx << ": indices " << raw_size << " -> " << compressed.size() << " bytes compressed" << std::endl;
+        if (!lods.empty()) {
+            skel.add("zlod", mesh_idx, encode_index_buffer(lod_indices));
+        }
+    } else if (vertex_count < 65536) {
+        // every index fits in 16 bits: half the index memory
+        std::vector<uint16_t> short_indices(indices.begin(), indices.end());
+        skel.add("ix16", mesh_idx, short_indices);
+        if (!lods.empty()) {
+            skel.add("lodi", mesh_idx, std::vector<uint16_t>(lod_indices.begin(), lod_indices.end()));
+        }
+    } else {
+        skel.add("indi", mesh_idx, indices);
+        if (!lods.empty()) {
+            skel.add("lodi", mesh_idx, lod_indices);
+        }
+    }
+
+    if (options.interleave) {
+        // one stream in exactly the layout the skinning shader reads, plus a description of that layout
+        std::vector<VertexAttribute> layout = skinned_vertex_layout(encoding);
+        uint32_t stride = layout[0].stride;
+        uint32_t position_offset = find_attribute(layout, SkinPosition)->offset;
+        uint32_t normal_offset = find_attribute(layout, SkinNormal)->offset;
+        uint32_t ids_offset = find_attribute(layout, SkinBoneIDs)->offset;
+        const VertexAttribute* weights_attribute = find_attribute(layout, SkinBoneWeights); // absent for one influence
+
+        VertexQuantization quantization;
+        if (encoding.quantized_positions && vertex_count > 0) {
+            glm::vec3 min(std::numeric_limits<float>::max());
+            glm::vec3 max(-std::numeric_limits<float>::max());
+            for (unsigned int vert_idx = 0; vert_idx < vertex_count; vert_idx++) {
+                glm::vec3 position(vertices[3 * vert_idx], vertices[3 * vert_idx + 1], vertices[3 * vert_idx + 2]);
+                min = glm::min(min, position);
+                max = glm::max(max, position);
+            }
+            quantization.position_min = min;
+            quantization.position_extent = max - min;
+        }
+
+        std::vector<uint8_t> stream(size_t(vertex_count) * stride, 0);
+        for (unsigned int vert_idx = 0; vert_idx < vertex_count; vert_idx++) {
+            uint8_t* vertex = stream.data() + size_t(vert_idx) * stride;
+            glm::vec3 position(vertices[3 * vert_idx], vertices[3 * vert_idx + 1], vertices[3 * vert_idx + 2]);
+            glm::vec3 normal(normals[3 * vert_idx], normals[3 * vert_idx + 1], normals[3 * vert_idx + 2]);
+            if (encoding.quantized_positions) {
+                QuantizedVec3 q = quantize_vec3(position, quantization.position_min, quantization.position_extent);
+                std::memcpy(vertex + position_offset, &q, sizeof(q));
+            } else {
+                std::memcpy(vertex + position_offset, &position, sizeof(position));
+            }
+            if (encoding.oct_normals) {
+                PackedNormal n = pack_normal(normal);
+                std::memcpy(vertex + normal_offset, &n, sizeof(n));
+            } else {
+                std::memcpy(vertex + normal_offset, &normal, sizeof(normal));
+            }
+            if (encoding.influences > 0) {
+                const auto& vertex_influences = influences[vert_idx];
+                for (uint32_t i = 0; i < encoding.influences && i < vertex_influences.size(); i++) {
+                    vertex[ids_offset + i] = uint8_t(vertex_influences[i].bone);
+                }
+                if (weights_attribute) {
+                    quantize_weights_unorm8(vertex_influences, encoding.influences, vertex + weights_attribute->offset);
+                }
+            } else {
+                std::memcpy(vertex + ids_offset, &bone_ids[vert_idx], sizeof(BoneID));
+                std::memcpy(vertex + weights_attribute->offset, &bone_weights[vert_idx], sizeof(BoneWeight));
+            }
+        }
+        if (options.compress) {
+            auto compressed = encode_vertex_buffer(stream.data(), vertex_count, stride);
+            skel.add("zstr", mesh_idx, compressed);
+            log << "Mesh " << mesh_idx << ": vertices " << stream.size() << " -> " << compressed.size() << " bytes compressed" << std::endl;
+        } else {
+            skel.add("strm", mesh_idx, stream, 4);
+        }
+        skel.add("vfmt", mesh_idx, layout);
+        if (encoding.quantized_positions) {
+            skel.add("vqnt", mesh_idx, std::vector<VertexQuantization>{quantization});
+        }
+        log << "Mesh " << mesh_idx << ": " << vertex_count << " vertices, " << stride << " bytes each ("
+                  << sizeof(SkinnedVertex) << " uncompressed)" << std::endl;
+    } else {
+        skel.add("vert", mesh_idx, vertices);
+        skel.add("norm", mesh_idx, normals);
+        skel.add("weig", mesh_idx, bone_weights);
+        skel.add("idss", mesh_idx, bone_ids);
+    }
+    skel.add("bone", mesh_idx, bones);
+}
+
+// value of a position / scale track at 'time' (in ticks): linear between the keys around it, held outside them
+glm::vec3 sample_track(const aiVectorKey* keys, unsigned int count, double time, const glm::vec3& fallback) {
+    if (count == 0) return fallback;
+    auto after = std::upper_bound(keys, keys + count, time, [](double t, const aiVectorKey& key) { return t < key.mTime; });
+    if (after == keys) return glm::vec3(keys[0].mValue.x, keys[0].mValue.y, keys[0].mValue.z);
+    if (after == keys + count) return glm::vec3(keys[count - 1].mValue.x, keys[count - 1].mValue.y, keys[count - 1].mValue.z);
+    const auto& a = after[-1];
+    const auto& b = after[0];
+    float t = (b.mTime > a.mTime ? float((time - a.mTime) / (b.mTime - a.mTime)) : 0.f);
+    return glm::mix(glm::vec3(a.mValue.x, a.mValue.y, a.mValue.z), glm::vec3(b.mValue.x, b.mValue.y, b.mValue.z), t);
+}
+
+// value of a rotation track at 'time' (in ticks): slerp between the keys around it, held outside them
+glm::quat sample_track(const aiQuatKey* keys, unsigned int count, double time) {
+    if (count == 0) return glm::quat(1.f, 0.f, 0.f, 0.f);
+    auto to_glm = [](const aiQuaternion& q) { return glm::quat{q.w, q.x, q.y, q.z}; };
+    auto after = std::upper_bound(keys, keys + count, time, [](double t, const aiQuatKey& key) { return t < key.mTime; });
+    if (after == keys) return to_glm(keys[0].mValue);
+    if (after == keys + count) return to_glm(keys[count - 1].mValue);
+    const auto& a = after[-1];
+    const auto& b = after[0];
+    float t = (b.mTime > a.mTime ? float((time - a.mTime) / (b.mTime - a.mTime)) : 0.f);
+    return glm::slerp(to_glm(a.mValue), to_glm(b.mValue), t);
+}
+
+// encode one animation into its own key pools (chunks indexed by 'clip_idx'), appending its channels to 'animations'
+Clip export_clip(const aiAnimation* animation, unsigned int clip_idx, const ExportOptions& options, const NodeIndex& node_index,
+                 const std::vector<float>& node_radius, std::vector<Animation>* animations_, SkelWriter* skel_, std::ostream& log) {
+    auto& animations = *animations_;
+    auto& skel = *skel_;
+
+    Clip clip;
+    std::memset(&clip, 0, sizeof(clip));
+    std::strncpy(clip.name, animation->mName.data, sizeof(clip.name) - 1);
+    clip.duration = float(animation->mDuration);
+    clip.ticks_per_second = float(animation->mTicksPerSecond != 0.0 ? animation->mTicksPerSecond : 25.0); // Assimp: 0 = unspecified
+    clip.sample_rate = options.sample_rate;
+    clip.first_channel = uint32_t(animations.size());
+    clip.channel_count = animation->mNumChannels;
+    // every channel gets a key at each 1 / sample_rate seconds over the whole clip, whatever times its tracks' keys are at
+    double seconds = std::max(0.0, animation->mDuration) / double(clip.ticks_per_second);
+    clip.num_frames = int32_t(std::floor(seconds * double(clip.sample_rate) + 0.5)) + 1;
+    if (options.max_key_error > 0.f && clip.num_frames > int32_t(std::numeric_limits<uint16_t>::max()) + 1) {
+        throw std::runtime_error("Clip '" + std::string(animation->mName.data) + "' has too many frames at this rate for key reduction");
+    }
+    log << "Clip " << clip_idx << ": " << animation->mName.data << ", " << animation->mNumChannels << " channels, "
+        << seconds << " s, " << clip.num_frames << " frames at " << clip.sample_rate << " Hz" << std::endl;
+
+    std::vector<glm::mat4> keys;
+    std::vector<TRSKey> trs_keys;
+    std::vector<glm::vec3> scale_keys;
+    std::vector<uint16_t> key_frames; // frame of each key in trs_keys, only written when keys are reduced
+    std::vector<QuantizedRange> ranges; // per channel, for the quantized layout
+    size_t keys_before_reduction = 0;
+
+    for (auto channel_idx = 0u; channel_idx < animation->mNumChannels; channel_idx++) {
+        auto node_anim = animation->mChannels[channel_idx];
+        if (options.prune_nodes && !node_index.count(std::string(node_anim->mNodeName.data))) {
+            log << "Skipped animation for " << node_anim->mNodeName.data << " (node pruned)" << std::endl;
+            continue;
+        }
+        log << "Found animation for " << node_anim->mNodeName.data << std::endl;
+        auto node_idx = find_node(node_index, std::string(node_anim->mNodeName.data));
+
+        animations.emplace_back();
+        auto& channel = animations.back();
+
+        channel.num_frames = clip.num_frames;
+        channel.num_keys = channel.num_frames;
+        channel.first_key = options.key_layout == ExportOptions::KeyLayout::Mat4 ? keys.size() : trs_keys.size();
+        channel.node_id = node_idx;
+
+        // evaluate each track at the frame times (tracks can have different key counts and times)
+        std::vector<glm::vec3> translations, scales;
+        std::vector<glm::quat> rotations;
+        bool has_scale = false;
+        for (int frame = 0; frame < clip.num_frames; frame++) {
+            double time = std::min(double(animation->mDuration), double(frame) / double(clip.sample_rate) * double(clip.ticks_per_second));
+            translations.push_back(sample_track(node_anim->mPositionKeys, node_anim->mNumPositionKeys, time, glm::vec3(0.f)));
+            rotations.push_back(sample_track(node_anim->mRotationKeys, node_anim->mNumRotationKeys, time));
+            scales.push_back(sample_track(node_anim->mScalingKeys, node_anim->mNumScalingKeys, time, glm::vec3(1.f)));
+            if (glm::length(scales.back() - glm::vec3(1.f)) > 1e-6f) {
+                has_scale = true;
+            }
+        }
+
+        std::vector<TRSKey> channel_keys;
+        std::vector<glm::vec3> channel_scales;
+        std::vector<uint16_t> channel_frames;
+
+        for (int i = 0; i < clip.num_frames; i++) {
+            const auto& scale = scales[i];
+            const auto& translation = translations[i];
+            const auto& rotation = rotations[i];
+
+            if (options.key_layout != ExportOptions::KeyLayout::Mat4) {
+                channel_keys.emplace_back();
+                channel_keys.back().rotation = rotation;
+                channel_keys.back().translation = translation;
+                channel_frames.push_back(uint16_t(i));
+                if (has_scale) {
+                    channel_scales.push_back(scale);
+                }
+            } else {
+                auto scale_mat = glm::scale(glm::mat4(1.f), scale);
+
+                auto translate_mat = glm::translate(glm::mat4(1.f), translation);
+
+                auto rotate_mat = glm::mat4_cast(rotation);
+
+                // rebuild node transform from animation data
+                // note to self: always scale then rotate then translate
+                keys.push_back(translate_mat * rotate_mat * scale_mat);
+            }
+        }
+
+        if (options.key_layout != ExportOptions::KeyLayout::Mat4) {
+            keys_before_reduction += channel_keys.size();
+            const QuantizedRange* quantized = nullptr;
+            if (options.key_layout == ExportOptions::KeyLayout::Quantized) {
+                ranges.push_back(key_range(channel_keys, channel_scales));
+                quantized = &ranges.back();
+            }
+            if (options.max_key_error > 0.f) {
+                reduce_keys(options.max_key_error, node_radius[node_idx], &channel_keys, &channel_scales, &channel_frames, quantized);
+            }
+
+            channel.num_keys = channel_keys.size();
+            if (has_scale) channel.first_scale = scale_keys.size();
+            trs_keys.insert(trs_keys.end(), channel_keys.begin(), channel_keys.end());
+            scale_keys.insert(scale_keys.end(), channel_scales.begin(), channel_scales.end());
+            key_frames.insert(key_frames.end(), channel_frames.begin(), channel_frames.end());
+        }
+
+        log << "Scaling keys: " << node_anim->mNumScalingKeys << std::endl;
+        log << "Position keys: " << node_anim->mNumPositionKeys << std::endl;
+        log << "Rptation keys: " << node_anim->mNumRotationKeys << std::endl;
+    }
+    clip.channel_count = uint32_t(animations.size()) - clip.first_channel;
+
+    if (options.max_key_error > 0.f) {
+        skel.add("kfrm", clip_idx, key_frames);
+        log << "Key reduction (max error " << options.max_key_error << "): "
+                  << keys_before_reduction << " keys -> " << trs_keys.size() << " keys" << std::endl;
+    }
+    if (options.key_layout == ExportOptions::KeyLayout::Quantized) {
+        std::vector<PackedQuat> packed_rotations;
+        std::vector<QuantizedVec3> packed_translations;
+        std::vector<QuantizedVec3> packed_scales;
+        float max_translation_error = 0.f;
+
+        for (auto channel_idx = clip.first_channel; channel_idx < clip.first_channel + clip.channel_count; channel_idx++) {
+            const auto& channel = animations[channel_idx];
+            const auto& range = ranges[channel_idx - clip.first_channel];
+
+            for (int i = 0; i < channel.num_keys; i++) {
+                const auto& key = trs_keys[channel.first_key + i];
+                packed_rotations.push_back(pack_quat(key.rotation));
+                packed_translations.push_back(quantize_vec3(key.translation, range.translation_min, range.translation_extent));
+                for (int c = 0; c < 3; c++) {
+                    float decoded = dequantize_unorm16(packed_translations.back().v[c], range.translation_min[c], range.translation_extent[c]);
+                    max_translation_error = std::max(max_translation_error, std::abs(decoded - key.translation[c]));
+                }
+                if (channel.first_scale != -1) {
+                    packed_scales.push_back(quantize_vec3(scale_keys[channel.first_scale + i], range.scale_min, range.scale_extent));
+                }
+            }
+        }
+
+        // packed pools are index-for-index with the float pools, so first_key / first_scale still apply
+        skel.add("qrot", clip_idx, packed_rotations, 2);
+        skel.add("qpos", clip_idx, packed_translations, 2);
+        skel.add("qscl", clip_idx, packed_scales, 2);
+        skel.add("qrng", clip_idx, ranges);
+        log << "Wrote " << clip.channel_count << " channels, " << packed_rotations.size() << " quantized keys, "
+                  << packed_scales.size() << " quantized scale keys ("
+                  << packed_rotations.size() * (sizeof(PackedQuat) + sizeof(QuantizedVec3))
+                     + packed_scales.size() * sizeof(QuantizedVec3) + ranges.size() * sizeof(QuantizedRange) << " bytes, vs "
+                  << trs_keys.size() * sizeof(TRSKey) + scale_keys.size() * sizeof(glm::vec3) << " as TRS; max translation error "
+                  << max_translation_error << ")" << std::endl;
+    } else if (options.key_layout == ExportOptions::KeyLayout::TRS) {
+        skel.add("trsk", clip_idx, trs_keys);
+        skel.add("scal", clip_idx, scale_keys);
+        log << "Wrote " << clip.channel_count << " channels, " << trs_keys.size() << " TRS keys, "
+                  << scale_keys.size() << " scale keys ("
+                  << trs_keys.size() * sizeof(TRSKey) + scale_keys.size() * sizeof(glm::vec3) << " bytes, vs "
+                  << trs_keys.size() * sizeof(glm::mat4) << " as mat4)" << std::endl;
+    } else {
+        skel.add("keys", clip_idx, keys);
+        log << "Wrote " << clip.channel_count << " channels, " << keys.size() << " keys ("
+                  << keys.size() * sizeof(glm::mat4) << " bytes)" << std::endl;
+    }
+    return clip;
+}
+
+// bone matrices of the character's skeleton at every frame of a clip, computed the way the runtime does (root
+//  transform * node's overall transform * bone offset) from the resampled keys: each frame is one row of the
+//  palette, holding each skeleton bone once (meshes find theirs through their "bmap" bone maps)
+std::vector<PaletteMatrix> bake_palette(const aiAnimation* animation, const Clip& clip, const std::vector<Bone>& skeleton,
+                                        const std::vector<Node>& nodes, const NodeIndex& node_index) {
+    std::vector<int> channel_of_node(nodes.size(), -1);
+    for (auto channel_idx = 0u; channel_idx < animation->mNumChannels; channel_idx++) {
+        auto found = node_index.find(std::string(animation->mChannels[channel_idx]->mNodeName.data));
+        if (found != node_index.end()) channel_of_node[found->second] = int(channel_idx); // (else: pruned)
+    }
+
+    std::vector<PaletteMatrix> palette;
+    palette.reserve(size_t(clip.num_frames) * skeleton.size());
+    std::vector<glm::mat4> overall(nodes.size());
+    for (int frame = 0; frame < clip.num_frames; frame++) {
+        double time = std::min(double(animation->mDuration), double(frame) / double(clip.sample_rate) * double(clip.ticks_per_second));
+        // nodes are in parent-before-child order
+        for (size_t node_idx = 0; node_idx < nodes.size(); node_idx++) {
+            glm::mat4 local = nodes[node_idx].transform;
+            if (channel_of_node[node_idx] >= 0) {
+                const auto node_anim = animation->mChannels[channel_of_node[node_idx]];
+                local = glm::translate(glm::mat4(1.f), sample_track(node_anim->mPositionKeys, node_anim->mNumPositionKeys, time, glm::vec3(0.f)))
+                      * glm::mat4_cast(sample_track(node_anim->mRotationKeys, node_anim->mNumRotationKeys, time))
+                      * glm::scale(glm::mat4(1.f), sample_track(node_anim->mScalingKeys, node_anim->mNumScalingKeys, time, glm::vec3(1.f)));
+            }
+            overall[node_idx] = (nodes[node_idx].parent_id >= 0 ? overall[nodes[node_idx].parent_id] * local : local);
+        }
+        for (const auto& bone : skeleton) {
+            palette.push_back(to_palette_matrix(nodes[0].transform * overall[bone.node_id] * bone.inverse_binding));
+        }
+    }
+    return palette;
+}
+
+// skin every mesh's vertices on the CPU at every frame of a clip, with the bone matrices from bake_palette (picked
+//  out through each mesh's 'bone_maps'), into a vertex animation texture: 'sources' are the meshes' "vsrc" chunks
+//  (output vertex -> imported vertex)
+VertexAnimationInfo bake_vertex_animation(const aiScene* scene, const Clip& clip, const std::vector<PaletteMatrix>& palette,
+                                          const std::vector<std::vector<uint32_t>>& bone_maps,
+                                          const std::vector<std::vector<uint32_t>>& sources, uint32_t type,
+                                          std::vector<char>* positions_, std::vector<char>* normals_) {
+    auto& positions = *positions_;
+    auto& normals = *normals_;
+    VertexAnimationInfo info;
+    info.type = type;
+    info.vertex_count = 0;
+    for (const auto& source : sources) {
+        info.vertex_count += uint32_t(source.size());
+    }
+    info.width = std::max(1u, std::min(info.vertex_count, VertexAnimationMaxWidth));
+    info.rows_per_frame = (info.vertex_count + info.width - 1) / info.width;
+    size_t frame_texels = size_t(info.width) * info.rows_per_frame;
+    size_t texel_size = (type == GL_HALF_FLOAT ? 4 * sizeof(uint16_t) : 4 * sizeof(float));
+    positions.assign(size_t(clip.num_frames) * frame_texels * texel_size, 0);
+    normals.assign(positions.size(), 0);
+
+    auto store = [&](std::vector<char>* to, size_t texel, const glm::vec4& value) {
+        char* out = to->data() + texel * texel_size;
+        if (type == GL_HALF_FLOAT) {
+            uint16_t half[4] = {pack_half(value.x), pack_half(value.y), pack_half(value.z), pack_half(value.w)};
+            std::memcpy(out, half, sizeof(half));
+        } else {
+            std::memcpy(out, &value, sizeof(value));
         }
     };
 
+    size_t palette_size = (clip.num_frames > 0 ? palette.size() / size_t(clip.num_frames) : 0);
+    for (int frame = 0; frame < clip.num_frames; frame++) {
+        size_t texel = size_t(frame) * frame_texels;
+        size_t first_bone = size_t(frame) * palette_size;
+        for (auto mesh_idx = 0u; mesh_idx < scene->mNumMeshes; mesh_idx++) {
+            const auto mesh = scene->mMeshes[mesh_idx];
+            // weighted sum of every bone's transform of each imported vertex (all of its influences, not just the exported ones)
+            std::vector<glm::vec3> skinned_positions(mesh->mNumVertices, glm::vec3(0.f));
+            std::vector<glm::vec3> skinned_normals(mesh->mNumVertices, glm::vec3(0.f));
+            std::vector<float> weight_sums(mesh->mNumVertices, 0.f);
+            for (auto bone_idx = 0u; bone_idx < mesh->mNumBones; bone_idx++) {
+                const auto bone = mesh->mBones[bone_idx];
+                glm::mat4 transform = from_palette_matrix(palette[first_bone + bone_maps[mesh_idx][bone_idx]]);
+                for (auto weight_idx = 0u; weight_idx < bone->mNumWeights; weight_idx++) {
+                    const auto& weight = bone->mWeights[weight_idx];
+                    const auto& p = mesh->mVertices[weight.mVertexId];
+                    const auto& n = mesh->mNormals[weight.mVertexId];
+                    skinned_positions[weight.mVertexId] += weight.mWeight * glm::vec3(transform * glm::vec4(p.x, p.y, p.z, 1.f));
+                    skinned_normals[weight.mVertexId] += weight.mWeight * glm::vec3(transform * glm::vec4(n.x, n.y, n.z, 0.f));
+                    weight_sums[weight.mVertexId] += weight.mWeight;
+                }
+            }
+            for (auto vert_idx : sources[mesh_idx]) {
+                const auto& p = mesh->mVertices[vert_idx];
+                const auto& n = mesh->mNormals[vert_idx];
+                glm::vec3 position(p.x, p.y, p.z);
+                glm::vec3 normal(n.x, n.y, n.z);
+                if (weight_sums[vert_idx] > 0.f) {
+                    // unweighted vertices stay where they are
+                    position = skinned_positions[vert_idx] / weight_sums[vert_idx];
+                    normal = skinned_normals[vert_idx];
+                }
+                float length = glm::length(normal);
+                store(&positions, texel, glm::vec4(position, 1.f));
+                store(&normals, texel, glm::vec4(length > 0.f ? normal / length : normal, 0.f));
+                texel++;
+            }
+        }
+    }
+    return info;
+}
+
+// keep only the nodes whose overall transform is used: bones, sockets, and their ancestors (cameras, lights and helper
+//  nulls off to the side are dropped, with any channels animating them). a static ancestor with only static children
+//  is folded into them: they get its transform premultiplied and its parent. the root stays at index 0, and
+//  'names' / 'node_index' are rebuilt for the remaining nodes, which stay in parent-before-child order.
+void prune_nodes(const aiScene* scene, const std::vector<std::string>& sockets, std::vector<Node>* nodes_,
+                 std::vector<std::string>* names_, NodeIndex* node_index_, std::ostream& log) {
+    auto& nodes = *nodes_;
+    auto& names = *names_;
+    auto& node_index = *node_index_;
+
+    std::vector<bool> needed(nodes.size(), false);
+    needed[0] = true;
+    for (auto mesh_idx = 0u; mesh_idx < scene->mNumMeshes; mesh_idx++) {
+        const auto mesh = scene->mMeshes[mesh_idx];
+        for (auto bone_idx = 0u; bone_idx < mesh->mNumBones; bone_idx++) {
+            needed[find_node(node_index, std::string(mesh->mBones[bone_idx]->mName.data))] = true;
+        }
+    }
+    for (const auto& socket : sockets) {
+        needed[find_node(node_index, socket)] = true;
+    }
+    std::vector<bool> animated(nodes.size(), false);
+    for (auto anim_idx = 0u; anim_idx < scene->mNumAnimations; anim_idx++) {
+        const auto animation = scene->mAnimations[anim_idx];
+        for (auto channel_idx = 0u; channel_idx < animation->mNumChannels; channel_idx++) {
+            auto found = node_index.find(std::string(animation->mChannels[channel_idx]->mNodeName.data));
+            if (found != node_index.end()) animated[found->second] = true;
+        }
+    }
+
+    // children come after their parents, so one backwards pass reaches every ancestor
+    std::vector<bool> keep(needed);
+    std::vector<bool> has_animated_child(nodes.size(), false);
+    for (size_t node_idx = nodes.size(); node_idx-- > 1; ) {
+        if (!keep[node_idx]) continue;
+        keep[nodes[node_idx].parent_id] = true;
+        if (animated[node_idx]) has_animated_child[nodes[node_idx].parent_id] = true;
+    }
+    std::vector<bool> folded(nodes.size(), false);
+    for (size_t node_idx = 1; node_idx < nodes.size(); node_idx++) {
+        folded[node_idx] = keep[node_idx] && !needed[node_idx] && !animated[node_idx] && !has_animated_child[node_idx];
+    }
+
+    std::vector<int> new_index(nodes.size(), -1);
+    std::vector<Node> kept;
+    std::vector<std::string> kept_names;
+    size_t dropped = 0, folds = 0;
+    for (size_t node_idx = 0; node_idx < nodes.size(); node_idx++) {
+        if (!keep[node_idx]) dropped++;
+        if (folded[node_idx]) folds++;
+        if (!keep[node_idx] || folded[node_idx]) continue;
+        glm::mat4 transform = nodes[node_idx].transform;
+        int parent = nodes[node_idx].parent_id;
+        while (parent >= 0 && folded[parent]) {
+            transform = nodes[parent].transform * transform;
+            parent = nodes[parent].parent_id;
+        }
+        new_index[node_idx] = int(kept.size());
+        kept.emplace_back(parent >= 0 ? new_index[parent] : -1, transform);
+        kept_names.push_back(names[node_idx]);
+    }
+    log << "Pruned hierarchy: " << nodes.size() << " nodes -> " << kept.size() << " (" << dropped << " unused, "
+        << folds << " static folded into their children)" << std::endl;
+
+    nodes = std::move(kept);
+    names = std::move(kept_names);
+    node_index.clear();
+    for (size_t node_idx = 0; node_idx < names.size(); node_idx++) {
+        node_index.emplace(names[node_idx], int(node_idx));
+    }
+}
+
+// split a bind transform into rotation, translation and (signed) scale, as stored in "nbnd"; shear has no TRS
+//  form, so 'error' is how far trs_to_mat4 of the result is from 'm' (0 up to rounding for ordinary transforms)
+NodeBind decompose_bind(const glm::mat4& m, float* error) {
+    NodeBind bind;
+    bind.translation = glm::vec3(m[3]);
+    glm::vec3 axes[3] = {glm::vec3(m[0]), glm::vec3(m[1]), glm::vec3(m[2])};
+    bind.scale = glm::vec3(glm::length(axes[0]), glm::length(axes[1]), glm::length(axes[2]));
+    if (glm::dot(glm::cross(axes[0], axes[1]), axes[2]) < 0.f) bind.scale.x = -bind.scale.x; // mirrored
+    glm::mat3 rotation(1.f);
+    for (int c = 0; c < 3; c++) {
+        if (bind.scale[c] != 0.f) rotation[c] = axes[c] / bind.scale[c];
+    }
+    bind.rotation = glm::quat_cast(rotation);
+    glm::mat4 rebuilt = trs_to_mat4(bind.rotation, bind.translation, bind.scale);
+    *error = 0.f;
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 4; r++) {
+            *error = std::max(*error, std::abs(rebuilt[c][r] - m[c][r]));
+        }
+    }
+    return bind;
+}
+
+// how far rotating / scaling each node can move anything, in the node's bind space: the farthest skinned vertex
+//  of its bones, or else at least its own bone length (distance from its parent), then bottom-up over the whole
+//  subtree, so key reduction bounds error at the farthest point a node moves (an error at the hip moves the hand)
+std::vector<float> compute_node_radius(const aiScene* scene, const std::vector<Node>& nodes, const NodeIndex& node_index) {
+    std::vector<float> radius(nodes.size(), 0.f);
+    for (auto mesh_idx = 0u; mesh_idx < scene->mNumMeshes; mesh_idx++) {
+        const auto mesh = scene->mMeshes[mesh_idx];
+        for (auto bone_idx = 0u; bone_idx < mesh->mNumBones; bone_idx++) {
+            const auto bone = mesh->mBones[bone_idx];
+            int node_idx = find_node(node_index, std::string(bone->mName.data));
+            glm::mat4 inverse_binding = aiMatrix4x4ToGlm(bone->mOffsetMatrix);
+            for (auto weight_idx = 0u; weight_idx < bone->mNumWeights; weight_idx++) {
+                if (bone->mWeights[weight_idx].mWeight <= 0.f) continue;
+                const auto& v = mesh->mVertices[bone->mWeights[weight_idx].mVertexId];
+                radius[node_idx] = std::max(radius[node_idx], glm::length(glm::vec3(inverse_binding * glm::vec4(v.x, v.y, v.z, 1.f))));
+            }
+        }
+    }
+    for (size_t node_idx = 0; node_idx < nodes.size(); node_idx++) {
+        if (radius[node_idx] == 0.f && nodes[node_idx].parent_id >= 0) {
+            radius[node_idx] = glm::length(glm::vec3(nodes[node_idx].transform[3]));
+        }
+    }
+    // nodes are in parent-before-child order, so walking backwards finishes each subtree before its parent;
+    //  a child's subtree reaches its offset plus its own radius (scaled by the child's bind scale)
+    for (size_t node_idx = nodes.size(); node_idx-- > 1;) {
+        const auto& node = nodes[node_idx];
+        if (node.parent_id < 0) continue;
+        float scale = std::max(glm::length(glm::vec3(node.transform[0])),
+                      std::max(glm::length(glm::vec3(node.transform[1])), glm::length(glm::vec3(node.transform[2]))));
+        radius[node.parent_id] = std::max(radius[node.parent_id], glm::length(glm::vec3(node.transform[3])) + scale * radius[node_idx]);
+    }
+    return radius;
+}
+
+// encode an imported scene's hierarchy, animations and meshes into 'skel'
+//  (meshes whose hash matches one in 'previous' are copied from it instead of re-encoded; both pointers may be null)
+void export_scene(const aiScene* scene, const ExportOptions& options, unsigned int mesh_threads,
+                  const PreviousExport* previous, CacheStats* stats, SkelWriter* skel_, std::ostream& log) {
+    auto& skel = *skel_;
+
+    std::vector<std::string> level_order_node_names;
+    NodeIndex node_index;
+    std::vector<Node> nodes;
+
     std::deque<std::pair<const aiNode*, int>> worklist;
     worklist.push_back({scene->mRootNode, -1});
     while(!worklist.empty()) {
         const auto& p = worklist.front();
         level_order_node_names.push_back(std::string(p.first->mName.data));
+        node_index.emplace(level_order_node_names.back(), int(level_order_node_names.size() - 1));
         nodes.emplace_back(p.second, aiMatrix4x4ToGlm(p.first->mTransformation));
         for (auto child_idx = 0u; child_idx < p.first->mNumChildren; child_idx++) {
             worklist.push_back({p.first->mChildren[child_idx], level_order_node_names.size() - 1});
@@ -66,137 +1070,542 @@ int main(int argc, char** argv) {
         worklist.pop_front();
     }
 
+    if (options.prune_nodes) {
+        prune_nodes(scene, options.sockets, &nodes, &level_order_node_names, &node_index, log);
+    }
+
     for (const auto& name : level_order_node_names) {
-        auto idx = find_idx(level_order_node_names, name);
-        std::cout << name << ", " << idx << ", " << nodes[idx].parent_id << std::endl;
+        auto idx = find_node(node_index, name);
+        log << name << ", " << idx << ", " << nodes[idx].parent_id << std::endl;
     }
 
+    // bind transforms are stored as TRS; everything baked below uses the rebuilt matrices, exactly as the game does
+    std::vector<NodeBind> node_binds;
+    float max_bind_error = 0.f;
+    for (auto& node : nodes) {
+        float error = 0.f;
+        node_binds.push_back(decompose_bind(node.transform, &error));
+        max_bind_error = std::max(max_bind_error, error);
+        node.transform = trs_to_mat4(node_binds.back().rotation, node_binds.back().translation, node_binds.back().scale);
+    }
+    if (max_bind_error > 1e-4f) {
+        log << "Warning: some bind transforms have shear, which TRS can't store (max error " << max_bind_error << ")" << std::endl;
+    }
+
+    // rotating / scaling a node moves its whole subtree and skin, so key reduction measures error at the farthest of them
+    std::vector<float> node_radius = compute_node_radius(scene, nodes, node_index);
 
-    auto num_animations = scene->mNumAnimations;
+    // each clip gets its own range of channels in "anim" and its own key pools (chunks indexed by clip)
     std::vector<Animation> animations;
+    std::vector<Clip> clips;
+    for (auto anim_idx = 0u; anim_idx < scene->mNumAnimations; anim_idx++) {
+        clips.push_back(export_clip(scene->mAnimations[anim_idx], anim_idx, options, node_index, node_radius, &animations, &skel, log));
+    }
+    // nodes record their channel in the first clip, for readers that only know about one
+    if (!clips.empty()) {
+        for (uint32_t channel = 0; channel < clips[0].channel_count; channel++) {
+            nodes[animations[channel].node_id].has_animation = true;
+            nodes[animations[channel].node_id].animation_id = int(channel);
+        }
+    }
+    skel.add("clip", 0, clips);
+    skel.add("anim", 0, animations);
+    // one skeleton for the whole character, plus each mesh's bones as indices into it
+    SkeletonBuilder skeleton;
+    std::vector<std::vector<uint32_t>> bone_maps(scene->mNumMeshes);
+    for (auto mesh_idx = 0u; mesh_idx < scene->mNumMeshes; mesh_idx++) {
+        const auto mesh = scene->mMeshes[mesh_idx];
+        for (auto bone_idx = 0u; bone_idx < mesh->mNumBones; bone_idx++) {
+            const auto bone = mesh->mBones[bone_idx];
+            bone_maps[mesh_idx].push_back(skeleton.add(Bone(find_node(node_index, std::string(bone->mName.data)), aiMatrix4x4ToGlm(bone->mOffsetMatrix))));
+        }
+    }
 
-	for (auto anim_idx = 0u; anim_idx < num_animations; anim_idx++) {
-		auto animation = scene->mAnimations[anim_idx];
-		std::cout << animation->mName.data << ", " << animation->mNumChannels << std::endl;
-		for (auto channel_idx = 0; channel_idx < animation->mNumChannels; channel_idx++) {
-			auto node_anim = animation->mChannels[channel_idx];
-			std::cout << "Found animation for " << node_anim->mNodeName.data << std::endl;
-            auto node_idx = find_idx(level_order_node_names, std::string(node_anim->mNodeName.data));
-
-			animations.emplace_back();
-            auto& animation = animations.back();
-            
-            animation.num_frames = node_anim->mNumRotationKeys;
-            animation.node_id = node_idx;
-            nodes[node_idx].has_animation = true;
-            nodes[node_idx].animation_id = animations.size() - 1;
-
-            for (unsigned i = 0; i < node_anim->mNumRotationKeys; i++) {
-                auto scale_aiv = node_anim->mScalingKeys[i].mValue;
-                auto scale_mat = glm::scale(glm::mat4(1.f), glm::vec3(scale_aiv.x, scale_aiv.y, scale_aiv.z));
-
-                auto translate_aiv = node_anim->mPositionKeys[i].mValue;
-                auto translate_mat = glm::translate(glm::mat4(1.f),
-                                                glm::vec3(translate_aiv.x, translate_aiv.y, translate_aiv.z));
-
-                auto quat_aiq = node_anim->mRotationKeys[i].mValue;
-                auto rotate_mat = glm::mat4_cast(glm::quat{quat_aiq.w, quat_aiq.x, quat_aiq.y, quat_aiq.z});
+    // vertex animation is skinned with the palette, so it is baked either way, but only written with -palette
+    std::vector<std::vector<PaletteMatrix>> palettes;
+    if (options.bake_palette || options.vertex_animation) {
+        for (auto anim_idx = 0u; anim_idx < scene->mNumAnimations; anim_idx++) {
+            palettes.push_back(bake_palette(scene->mAnimations[anim_idx], clips[anim_idx], skeleton.bones, nodes, node_index));
+        }
+    }
+    if (options.bake_palette) {
+        for (auto anim_idx = 0u; anim_idx < scene->mNumAnimations; anim_idx++) {
+            const auto& palette = palettes[anim_idx];
+            skel.add("pall", anim_idx, palette, 16);
+            log << "Clip " << anim_idx << ": baked palette of " << clips[anim_idx].num_frames << " frames x "
+                << (clips[anim_idx].num_frames > 0 ? palette.size() / clips[anim_idx].num_frames : 0) << " bones ("
+                << palette.size() * sizeof(PaletteMatrix) << " bytes)" << std::endl;
+        }
+    }
+    std::vector<int32_t> node_parents, node_channels;
+    for (size_t node_idx = 0; node_idx < nodes.size(); node_idx++) {
+        if (!(nodes[node_idx].parent_id < int(node_idx))) {
+            throw std::runtime_error("hierarchy is not in parent-before-child order"); // (level order always is)
+        }
+        node_parents.push_back(nodes[node_idx].parent_id);
+        node_channels.push_back(nodes[node_idx].has_animation ? nodes[node_idx].animation_id : -1);
+    }
+    skel.add("npar", 0, node_parents);
+    skel.add("nbnd", 0, node_binds);
+    skel.add("nchn", 0, node_channels);
+    log << "Hierarchy: " << nodes.size() << " nodes, " << nodes.size() * (2 * sizeof(int32_t) + sizeof(NodeBind))
+        << " bytes (" << nodes.size() * sizeof(Node) << " as Node records)" << std::endl;
+    if (!options.sockets.empty()) {
+        std::vector<Socket> sockets;
+        for (const auto& name : options.sockets) {
+            sockets.emplace_back();
+            std::memset(&sockets.back(), 0, sizeof(Socket));
+            std::strncpy(sockets.back().name, name.c_str(), sizeof(sockets.back().name) - 1);
+            sockets.back().node_id = find_node(node_index, name);
+        }
+        skel.add("sock", 0, sockets);
+    }
 
-                // rebuild node transform from animation data
-                // note to self: always scale then rotate then translate
-                animation.keys[i] = translate_mat * rotate_mat * scale_mat;
+    // meshes are independent: encode them concurrently, then add their chunks in mesh order
+    uint64_t options_hash = hash_options(options);
+    std::vector<SkelWriter> mesh_chunks(scene->mNumMeshes);
+    std::vector<std::ostringstream> mesh_logs(scene->mNumMeshes);
+    std::vector<uint64_t> mesh_hashes(scene->mNumMeshes);
+    parallel_for(scene->mNumMeshes, mesh_threads, [&](size_t mesh_idx) {
+        const auto mesh = scene->mMeshes[mesh_idx];
+        mesh_hashes[mesh_idx] = hash_mesh(mesh, node_index, options_hash);
+        if (previous && reuse_mesh(*previous, mesh_hashes[mesh_idx], unsigned(mesh_idx), &mesh_chunks[mesh_idx])) {
+            mesh_logs[mesh_idx] << "Mesh " << mesh_idx << ": unchanged, reused from previous export" << std::endl;
+            if (stats) stats->mesh_hits++;
+            return;
+        }
+        export_mesh(mesh, unsigned(mesh_idx), options, node_index, &mesh_chunks[mesh_idx], mesh_logs[mesh_idx]);
+        if (stats) stats->mesh_misses++;
+    });
+    if (options.vertex_animation) {
+        std::vector<std::vector<uint32_t>> sources(scene->mNumMeshes);
+        for (auto mesh_idx = 0u; mesh_idx < scene->mNumMeshes; mesh_idx++) {
+            for (const auto& chunk : mesh_chunks[mesh_idx].chunks) {
+                if (std::string(chunk.entry.magic, 4) != "vsrc") continue;
+                sources[mesh_idx].resize(chunk.data.size() / sizeof(uint32_t));
+                std::memcpy(sources[mesh_idx].data(), chunk.data.data(), sources[mesh_idx].size() * sizeof(uint32_t));
             }
+        }
+        for (auto anim_idx = 0u; anim_idx < scene->mNumAnimations; anim_idx++) {
+            std::vector<char> positions, normals;
+            auto info = bake_vertex_animation(scene, clips[anim_idx], palettes[anim_idx], bone_maps, sources, options.vertex_animation,
+                                              &positions, &normals);
+            skel.add("vati", anim_idx, std::vector<VertexAnimationInfo>{info});
+            skel.add("vatp", anim_idx, positions, 16);
+            skel.add("vatn", anim_idx, normals, 16);
+            log << "Clip " << anim_idx << ": vertex animation of " << clips[anim_idx].num_frames << " frames x "
+                << info.vertex_count << " vertices (" << info.width << " x " << info.rows_per_frame * clips[anim_idx].num_frames
+                << " texels, " << positions.size() + normals.size() << " bytes)" << std::endl;
+        }
+    }
+    for (auto mesh_idx = 0u; mesh_idx < scene->mNumMeshes; mesh_idx++) {
+        skel.add("bmap", mesh_idx, bone_maps[mesh_idx]);
+    }
+    skel.add("skbn", 0, skeleton.bones);
+    size_t mesh_bones = 0;
+    for (auto mesh_idx = 0u; mesh_idx < scene->mNumMeshes; mesh_idx++) {
+        mesh_bones += scene->mMeshes[mesh_idx]->mNumBones;
+    }
+    log << "Skeleton: " << skeleton.bones.size() << " bones (" << mesh_bones << " over all meshes)" << std::endl;
 
-			std::cout << "Scaling keys: " << node_anim->mNumScalingKeys << std::endl;
-			std::cout << "Position keys: " << node_anim->mNumPositionKeys << std::endl;
-			std::cout << "Rptation keys: " << node_anim->mNumRotationKeys << std::endl;
-		}
-	}
-
-    std::ofstream animations_out(data_path("skeletal/animations.dat"), std::ios::binary);
-    write_chunk("anim", animations, &animations_out);
-    animations_out.close();
-
-    std::ofstream node_out(data_path("skeletal/nodes.dat"), std::ios::binary);
-    write_chunk("node", nodes, &node_out);
-    node_out.close();
+    // find meshes that repeat an earlier mesh's geometry before any chunks are moved out
+    std::vector<uint64_t> geometry_hashes(scene->mNumMeshes);
+    std::vector<int> geometry_sources(scene->mNumMeshes, -1);
+    std::unordered_map<uint64_t, unsigned int> geometry_by_hash;
+    for (auto mesh_idx = 0u; mesh_idx < scene->mNumMeshes; mesh_idx++) {
+        geometry_hashes[mesh_idx] = hash_geometry(mesh_chunks[mesh_idx]);
+        auto found = geometry_by_hash.emplace(geometry_hashes[mesh_idx], mesh_idx).first;
+        if (found->second != mesh_idx && same_geometry(mesh_chunks[found->second], mesh_chunks[mesh_idx])) {
+            geometry_sources[mesh_idx] = int(found->second);
+        }
+    }
+    for (auto mesh_idx = 0u; mesh_idx < scene->mNumMeshes; mesh_idx++) {
+        auto& chunks = mesh_chunks[mesh_idx].chunks;
+        std::vector<char> magics;
+        for (const auto& chunk : chunks) {
+            magics.insert(magics.end(), chunk.entry.magic, chunk.entry.magic + 4);
+        }
+        skel.add("mhsh", mesh_idx, std::vector<uint64_t>{mesh_hashes[mesh_idx]});
+        skel.add("mchk", mesh_idx, magics); // (all of them: a mesh stored as a "gref" isn't reused by later exports)
+        skel.add("ghsh", mesh_idx, std::vector<uint64_t>{geometry_hashes[mesh_idx]});
+        if (geometry_sources[mesh_idx] >= 0) {
+            size_t bytes = 0;
+            for (auto& chunk : chunks) {
+                if (is_geometry_chunk(chunk)) {
+                    bytes += chunk.data.size();
+                } else {
+                    skel.chunks.push_back(std::move(chunk));
+                }
+            }
+            skel.add("gref", mesh_idx, std::vector<uint32_t>{uint32_t(geometry_sources[mesh_idx])});
+            mesh_logs[mesh_idx] << "Mesh " << mesh_idx << ": same geometry as mesh " << geometry_sources[mesh_idx]
+                                << ", stored once (" << bytes << " bytes saved)" << std::endl;
+        } else {
+            skel.chunks.insert(skel.chunks.end(), std::make_move_iterator(chunks.begin()), std::make_move_iterator(chunks.end()));
+        }
+        log << mesh_logs[mesh_idx].str();
+    }
+}
 
-    std::vector<int> num_meshes;
-    num_meshes.push_back(scene->mNumMeshes);
-    std::ofstream num_out(data_path("skeletal/num.dat"), std::ios::binary);
-    write_chunk("nums", num_meshes, &num_out);
-    num_out.close();
+// import one asset and write it as a .skel file; returns false (after logging why) if it fails
+//  unless 'force' is set, an output already built from the same source bytes + options is left alone,
+//  and unchanged meshes are copied from it rather than re-encoded
+bool export_asset(const std::string& input, const std::string& output, const ExportOptions& options,
+                  unsigned int mesh_threads, bool force, CacheStats* stats, ImportTimes* times, std::ostream& log) {
+    std::ifstream source(input, std::ios::binary);
+    source.seekg(0, std::ios::end);
+    std::vector<char> source_bytes(std::max<std::streamoff>(0, source.tellg()));
+    source.seekg(0, std::ios::beg);
+    source.read(source_bytes.data(), source_bytes.size());
+    if (!source) {
+        log << "Could not read " << input << ".\n";
+        return false;
+    }
+    ContentHash source_hash;
+    source_hash.add(source_bytes.data(), source_bytes.size());
+    source_bytes = std::vector<char>();
+    ExportStamp stamp{source_hash.finish(), hash_options(options)};
 
-    for (auto mesh_idx = 0u; mesh_idx < scene->mNumMeshes; mesh_idx++) {
-        std::vector<float> vertices;
-        std::vector<float> normals;
-        std::vector<unsigned int> indices;
-        std::vector<BoneWeight> bone_weights;
-        std::vector<BoneID> bone_ids;
-        std::vector<Bone> bones;
+    std::unique_ptr<PreviousExport> previous = (force ? nullptr : load_previous_export(output));
+    if (previous && previous->has_stamp
+        && previous->stamp.source_hash == stamp.source_hash && previous->stamp.options_hash == stamp.options_hash) {
+        log << output << " is up to date" << std::endl;
+        if (stats) stats->asset_hits++;
+        return true;
+    }
+    if (stats) stats->asset_misses++;
 
-        std::string prefix = std::string("skeletal/mesh") + std::to_string(mesh_idx);
+    // one importer per asset: Assimp importers must not be shared between threads
+    Assimp::Importer importer;
 
-        const auto mesh = scene->mMeshes[mesh_idx];
-        for (unsigned int vert_idx = 0; vert_idx < mesh->mNumVertices; vert_idx++) {
-            vertices.push_back(mesh->mVertices[vert_idx].x);
-            vertices.push_back(mesh->mVertices[vert_idx].y);
-            vertices.push_back(mesh->mVertices[vert_idx].z);
-            bone_weights.emplace_back();
-            bone_ids.emplace_back();
+    ImportTimer timer;
+    if (times) {
+        importer.SetProgressHandler(&timer);
+        active_import_timer = &timer;
+    }
+    const aiScene* scene = importer.ReadFile(input, options.import_steps);
+    if (times) {
+        importer.SetProgressHandler(nullptr); // (the importer doesn't own 'timer')
+        active_import_timer = nullptr;
+        float total = 0.f;
+        log << "Import steps:";
+        for (const auto& step : timer.steps) {
+            log << " " << step.first << " " << step.second * 1000.f << " ms;";
+            total += step.second;
+            times->add(step.first, step.second);
         }
+        log << " total " << total * 1000.f << " ms" << std::endl;
+    }
 
-        std::ofstream vertices_out(data_path(prefix + std::string("vertices.dat")), std::ios::binary);
-        write_chunk("vert", vertices, &vertices_out);
-        vertices_out.close();
+    if (scene == nullptr) {
+        log << "Could not load " << input << ": " << importer.GetErrorString() << "\n";
+        return false;
+    }
 
-        for (unsigned int vert_idx = 0; vert_idx < mesh->mNumVertices; vert_idx++) {
-            normals.push_back(mesh->mNormals[vert_idx].x);
-            normals.push_back(mesh->mNormals[vert_idx].y);
-            normals.push_back(mesh->mNormals[vert_idx].z);
-        }
+    SkelWriter skel;
+    export_scene(scene, options, mesh_threads, previous.get(), stats, &skel, log);
+    skel.add("srch", 0, std::vector<ExportStamp>{stamp});
 
-        std::ofstream normals_out(data_path(prefix + std::string("normals.dat")), std::ios::binary);
-        write_chunk("norm", normals, &normals_out);
-        normals_out.close();
+    // everything is in 'skel' now, so the scene (and the previous export) can go before the (possibly slow) write
+    importer.FreeScene();
+    scene = nullptr;
+    previous.reset();
 
-        for (unsigned int face_idx = 0; face_idx < mesh->mNumFaces; face_idx++) {
-            const auto& face = mesh->mFaces[face_idx];
-            for (unsigned int idx_idx = 0; idx_idx < face.mNumIndices; idx_idx++) {
-                indices.push_back(face.mIndices[idx_idx]);
+    std::ofstream skel_out(output, std::ios::binary);
+    skel.write(&skel_out);
+    skel_out.close();
+    if (!skel_out) {
+        log << "Could not write " << output << ".\n";
+        return false;
+    }
+    log << "Wrote " << output << std::endl;
+    return true;
+}
+
+// count the meshes of a batch whose geometry is already in an earlier mesh of the same asset or of another one:
+//  the former are stored once ("gref"), the latter are uploaded once by the game (by "ghsh")
+void report_shared_geometry(const std::vector<std::string>& outputs) {
+    std::unordered_map<uint64_t, size_t> first_asset; // geometry hash -> the first asset it appeared in
+    size_t meshes = 0, within = 0, across = 0;
+    for (size_t output_idx = 0; output_idx < outputs.size(); output_idx++) {
+        std::unique_ptr<SkelFile> file;
+        try {
+            file.reset(new SkelFile(outputs[output_idx], true));
+        } catch (std::exception&) {
+            continue; // failed to export: already reported
+        }
+        for (const auto& entry : file->entries) {
+            if (std::string(entry.magic, 4) != "ghsh") continue;
+            auto hash = file->read<uint64_t>("ghsh", entry.index);
+            if (hash.size() != 1) continue;
+            meshes++;
+            auto found = first_asset.emplace(hash[0], output_idx).first;
+            if (file->find("gref", entry.index)) {
+                within++;
+            } else if (found->second != output_idx) {
+                across++;
             }
         }
+    }
+    std::cout << "Geometry: " << meshes << " mesh(es), " << within << " stored once within an asset, "
+              << across << " shared with another asset (" << first_asset.size() << " unique)" << std::endl;
+}
 
-        std::ofstream indices_out(data_path(prefix + std::string("indices.dat")), std::ios::binary);
-        write_chunk("indi", indices, &indices_out);
-        indices_out.close();
+// parse a whole argument as a finite float; false (leaving *number alone) for empty, partial or out-of-range text
+bool parse_float(const std::string& value, float* number) {
+    char* end = nullptr;
+    errno = 0;
+    float parsed = std::strtof(value.c_str(), &end);
+    if (value.empty() || *end != '\0' || errno == ERANGE || !std::isfinite(parsed)) return false;
+    *number = parsed;
+    return true;
+}
 
-        for (auto bone_idx = 0u; bone_idx < mesh->mNumBones; bone_idx++) {
-            auto bone = mesh->mBones[bone_idx];
-            auto node_idx = find_idx(level_order_node_names, std::string(bone->mName.data));
-            bones.emplace_back(node_idx, aiMatrix4x4ToGlm(bone->mOffsetMatrix));
-            std::cout << bone->mName.data << ", " << bone->mNumWeights << std::endl;
+// parse a whole argument as a base 10 integer in [min_value, max_value]; false (leaving *number alone) otherwise
+bool parse_int(const std::string& value, long min_value, long max_value, long* number) {
+    char* end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || errno == ERANGE || parsed < min_value || parsed > max_value) return false;
+    *number = parsed;
+    return true;
+}
 
-		    for (unsigned int weight_idx = 0; weight_idx < bone->mNumWeights; weight_idx++) {
-                const auto& weight = bone->mWeights[weight_idx];
-                bone_weights.at(weight.mVertexId).insert(weight.mWeight);
-                bone_ids.at(weight.mVertexId).insert(bone_idx);
-            }
-	    }
+// parse a comma separated list of LOD ratios ("0.5,0.25,0.1"): each in (0, 1) and smaller than the one before
+bool parse_lod_ratios(const std::string& value, std::vector<float>* ratios_) {
+    auto& ratios = *ratios_;
+    ratios.clear();
+    std::istringstream in(value);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        char* end = nullptr;
+        float ratio = std::strtof(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || !(ratio > 0.f && ratio < 1.f)) return false;
+        if (!ratios.empty() && ratio >= ratios.back()) return false;
+        ratios.push_back(ratio);
+    }
+    return !ratios.empty();
+}
 
-        std::ofstream weights_out(data_path(prefix + std::string("weights.dat")), std::ios::binary);
-        write_chunk("weig", bone_weights, &weights_out);
-        weights_out.close();
+int main(int argc, char** argv) {
+    ExportOptions options;
+    std::vector<std::string> inputs;
+    std::string output_dir;
+    unsigned int threads = default_thread_count();
+    unsigned int benchmark_nodes = 0;
+    bool self_test = false;
+    bool force = false;
+    bool timing = false;
+    for (int arg_idx = 1; arg_idx < argc; arg_idx++) {
+        std::string arg = argv[arg_idx];
+        std::string value = (arg_idx + 1 < argc ? argv[arg_idx + 1] : "");
+        float number = 0.f;
+        long integer = 0;
+        if (arg == "-keys" && value == "trs") {
+            options.key_layout = ExportOptions::KeyLayout::TRS;
+            arg_idx++;
+        } else if (arg == "-keys" && value == "mat4") {
+            options.key_layout = ExportOptions::KeyLayout::Mat4;
+            arg_idx++;
+        } else if (arg == "-keys" && value == "quantized") {
+            options.key_layout = ExportOptions::KeyLayout::Quantized;
+            arg_idx++;
+        } else if (arg == "-rate" && parse_float(value, &number) && number > 0.f) {
+            options.sample_rate = number;
+            arg_idx++;
+        } else if (arg == "-reduce" && parse_float(value, &number) && number >= 0.f) {
+            options.max_key_error = number;
+            arg_idx++;
+        } else if (arg == "-interleave") {
+            options.interleave = true;
+        } else if (arg == "-positions" && value == "float") {
+            options.vertex_encoding.quantized_positions = false;
+            arg_idx++;
+        } else if (arg == "-positions" && value == "unorm16") {
+            options.vertex_encoding.quantized_positions = true;
+            options.interleave = true;
+            arg_idx++;
+        } else if (arg == "-normals" && value == "float") {
+            options.vertex_encoding.oct_normals = false;
+            arg_idx++;
+        } else if (arg == "-normals" && value == "oct") {
+            options.vertex_encoding.oct_normals = true;
+            options.interleave = true;
+            arg_idx++;
+        } else if (arg == "-influences" && parse_int(value, 1, 4, &integer) && integer != 3) {
+            options.vertex_encoding.influences = uint32_t(integer);
+            options.interleave = true;
+            arg_idx++;
+        } else if (arg == "-palette") {
+            options.bake_palette = true;
+        } else if (arg == "-vat" && value == "float") {
+            options.vertex_animation = GL_FLOAT;
+            arg_idx++;
+        } else if (arg == "-vat" && value == "half") {
+            options.vertex_animation = GL_HALF_FLOAT;
+            arg_idx++;
+        } else if (arg == "-compress") {
+            options.compress = true;
+            options.interleave = true;
+        } else if (arg == "-process" && find_import_preset(value, &options.import_steps)) {
+            arg_idx++;
+        } else if (arg == "-timing") {
+            timing = true;
+        } else if (arg == "-prune") {
+            options.prune_nodes = true;
+        } else if (arg == "-socket" && !value.empty()) {
+            options.sockets.push_back(value);
+            arg_idx++;
+        } else if (arg == "-meshlets") {
+            options.meshlets = true;
+        } else if (arg == "-lods" && parse_lod_ratios(value, &options.lod_ratios)) {
+            arg_idx++;
+        } else if (arg == "-optimize") {
+            options.optimize_vertex_cache = true;
+        } else if (arg == "-overdraw") {
+            options.optimize_vertex_cache = true;
+            options.optimize_overdraw = true;
+        } else if (arg == "-clusters" && parse_float(value, &number) && number >= 0.f) {
+            options.optimize_vertex_cache = true;
+            options.optimize_overdraw = true;
+            options.overdraw_split = number;
+            arg_idx++;
+        } else if (arg == "-o" && !value.empty()) {
+            output_dir = value;
+            arg_idx++;
+        } else if (arg == "-j" && parse_int(value, 1, 256, &integer)) {
+            threads = unsigned(integer);
+            arg_idx++;
+        } else if (arg == "-force") {
+            force = true;
+        } else if (arg == "-benchmark" && parse_int(value, 1, 1 << 20, &integer)) {
+            benchmark_nodes = unsigned(integer);
+            arg_idx++;
+        } else if (arg == "-selftest") {
+            self_test = true;
+        } else if (!arg.empty() && arg[0] != '-') {
+            inputs.push_back(arg);
+        } else {
+            // unknown option, or a known one with a missing / malformed / out-of-range value
+            std::cerr << "Bad option or value at '" << arg << (value.empty() ? "" : " " + value) << "'\n";
+            std::cerr << "Usage: export [-process minimal|full|legacy] [-timing] [-keys trs|mat4|quantized] [-rate hz] [-reduce max_error] [-palette] [-vat float|half] [-interleave] [-compress] [-positions float|unorm16] [-normals float|oct] [-influences 1|2|4] [-prune] [-socket node] [-optimize] [-overdraw] [-clusters lambda] [-meshlets] [-lods ratio,ratio,...] [-j threads] [-o output_dir] [-force] [-benchmark nodes] [-selftest] [input files or directories...]\n";
+            return -1;
+        }
+    }
 
-        std::ofstream ids_out(data_path(prefix + std::string("ids.dat")), std::ios::binary);
-        write_chunk("idss", bone_ids, &ids_out);
-        ids_out.close();
+    if (options.max_key_error > 0.f && options.key_layout == ExportOptions::KeyLayout::Mat4) {
+        std::cerr << "-reduce needs keys that can be interpolated (-keys trs or quantized).\n";
+        return -1;
+    }
+
+    if (self_test) {
+        // round-trip the codecs and packings on edge cases; a nonzero exit status means something broke
+        return run_self_test(std::cout) ? 0 : 1;
+    }
 
-        std::ofstream bones_out(data_path(prefix + std::string("bones.dat")), std::ios::binary);
-        write_chunk("bone", bones, &bones_out);
-        bones_out.close();
+    if (benchmark_nodes > 0) {
+        // export synthetic rigs of doubling size; if export scales linearly, time per node stays flat
+        for (unsigned int node_count = std::max(1u, benchmark_nodes / 8); ; node_count = std::min(benchmark_nodes, node_count * 2)) {
+            std::unique_ptr<aiScene> scene(make_synthetic_rig(node_count, 30));
+            SkelWriter skel;
+            std::ostringstream log;
+            auto start = std::chrono::steady_clock::now();
+            export_scene(scene.get(), options, threads, nullptr, nullptr, &skel, log);
+            float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+            std::cout << node_count << " nodes / bones / channels: " << seconds * 1000.0f << " ms ("
+                      << seconds * 1e6f / float(node_count) << " us per node)" << std::endl;
+            if (node_count == benchmark_nodes) break;
+        }
+        return 0;
+    }
 
+    // expand directories into the files in them that Assimp can import, and pick an output for each input
+    std::vector<std::string> input_files;
+    std::vector<std::string> output_files;
+    if (inputs.empty()) {
+        // no inputs: the bundled asset, written where the game looks for it
+        input_files.push_back(data_path("bastionik.dae"));
+        output_files.push_back(data_path("skeletal.skel"));
+    } else {
+        Assimp::Importer importer;
+        for (const auto& input : inputs) {
+            if (is_directory(input)) {
+                for (const auto& file : list_directory(input)) {
+                    auto dot = file.rfind('.');
+                    if (dot != std::string::npos && importer.IsExtensionSupported(file.substr(dot))) {
+                        input_files.push_back(file);
+                    }
+                }
+            } else {
+                input_files.push_back(input);
+            }
+        }
+        for (const auto& file : input_files) {
+            auto begin = file.find_last_of("/\\");
+            begin = (begin == std::string::npos ? 0 : begin + 1);
+            auto end = file.rfind('.');
+            if (end == std::string::npos || end < begin) end = file.size();
+            std::string name = file.substr(begin, end - begin) + ".skel";
+            output_files.push_back(output_dir.empty() ? data_path(name) : output_dir + "/" + name);
+        }
+        std::vector<std::string> sorted_outputs = output_files;
+        std::sort(sorted_outputs.begin(), sorted_outputs.end());
+        auto duplicate = std::adjacent_find(sorted_outputs.begin(), sorted_outputs.end());
+        if (duplicate != sorted_outputs.end()) {
+            std::cerr << "Two inputs would both be written to " << *duplicate << ".\n";
+            return -1;
+        }
+    }
+    if (input_files.empty()) {
+        std::cerr << "No importable assets found.\n";
+        return -1;
+    }
 
+    // assets are spread over worker threads; threads left over go to the meshes within each asset
+    unsigned int asset_threads = unsigned(std::min<size_t>(threads, input_files.size()));
+    unsigned int mesh_threads = std::max(1u, threads / asset_threads);
 
+    auto start = std::chrono::steady_clock::now();
+    std::mutex log_mutex;
+    std::atomic<size_t> failed(0);
+    CacheStats stats;
+    ImportTimes times;
+    if (timing) {
+        // Assimp names its post-process steps in debug messages; the logger owns the stream
+        // (VERBOSE: steps log their names at debug severity, which NORMAL drops; no default file / debugger streams)
+        Assimp::DefaultLogger::create(nullptr, Assimp::Logger::VERBOSE, 0);
+        Assimp::DefaultLogger::get()->attachStream(new ImportTimerLogStream, Assimp::Logger::Debugging);
     }
-}
\ No newline at end of file
+    parallel_for(input_files.size(), asset_threads, [&](size_t file_idx) {
+        std::ostringstream log;
+        bool ok = false;
+        try {
+            ok = export_asset(input_files[file_idx], output_files[file_idx], options, mesh_threads, force, &stats,
+                              timing ? &times : nullptr, log);
+        } catch (std::exception& e) {
+            log << "Failed to export " << input_files[file_idx] << ": " << e.what() << "\n";
+        }
+        if (!ok) failed++;
+        // one asset's output at a time, so logs from different workers don't interleave
+        std::lock_guard<std::mutex> lock(log_mutex);
+        (ok ? std::cout : std::cerr) << log.str() << std::flush;
+    });
+    float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    if (timing) {
+        Assimp::DefaultLogger::kill();
+        // where import time went over the whole batch, slowest step first (summed over threads, so it can exceed the wall time)
+        std::sort(times.steps.begin(), times.steps.end(),
+                  [](const std::pair<std::string, float>& a, const std::pair<std::string, float>& b) { return a.second > b.second; });
+        std::cout << "Import time by step:" << std::endl;
+        for (const auto& step : times.steps) {
+            std::cout << "  " << step.first << ": " << step.second << " s" << std::endl;
+        }
+    }
+
+    std::cout << "Exported " << input_files.size() - failed << " of " << input_files.size() << " assets in "
+              << seconds << "s (" << asset_threads << " asset thread(s) x " << mesh_threads << " mesh thread(s))" << std::endl;
+    report_shared_geometry(output_files);
+    std::cout << "Cache: " << stats.asset_hits << " asset(s) up to date, " << stats.asset_misses << " re-exported; "
+              << stats.mesh_hits << " mesh(es) reused, " << stats.mesh_misses << " encoded" << std::endl;
+    return (failed == 0 ? 0 : -1);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+//Assimp post-process presets, shared by the exporter (-process) and the game's direct-from-Assimp fallback.
+// post-processing is most of the time an import takes, so only ask for what the skinning path reads.
+
+#include <assimp/postprocess.h>
+
+#include <string>
+
+//triangles with shared vertices, split by primitive type, with normals generated if the file has none:
+// everything export_scene / AnimatedMesh read. (no tangent space: nothing uses tangents)
+constexpr unsigned int ImportSkinnedMinimal =
+	aiProcess_Triangulate |
+	aiProcess_JoinIdenticalVertices |
+	aiProcess_SortByPType |
+	aiProcess_GenSmoothNormals;
+
+//Assimp's own "max quality" realtime preset: also validates, merges / instances meshes, limits bone weights,
+// fixes degenerate / invalid data and improves cache locality. much slower; for assets that need the cleanup.
+constexpr unsigned int ImportFull = aiProcessPreset_TargetRealtime_MaxQuality;
+
+//what the exporter used before presets (tangents included), to reproduce older exports exactly:
+constexpr unsigned int ImportLegacy =
+	aiProcess_CalcTangentSpace |
+	aiProcess_Triangulate |
+	aiProcess_JoinIdenticalVertices |
+	aiProcess_SortByPType;
+
+//preset flags by name ("minimal", "full" or "legacy"); returns false for other names:
+inline bool find_import_preset(std::string const &name, unsigned int *flags) {
+	if (name == "minimal") *flags = ImportSkinnedMinimal;
+	else if (name == "full") *flags = ImportFull;
+	else if (name == "legacy") *flags = ImportLegacy;
+	else return false;
+	return true;
+}
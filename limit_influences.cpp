@@ -0,0 +1,54 @@
+#include "limit_influences.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+	void normalize_weights(std::vector< BoneInfluence > *influences_) {
+		auto &influences = *influences_;
+		float total = 0.0f;
+		for (auto const &influence : influences) total += influence.weight;
+		if (total <= 0.0f) return;
+		for (auto &influence : influences) influence.weight /= total;
+	}
+}
+
+uint32_t limit_influences(std::vector< std::vector< BoneInfluence > > *influences_, uint32_t max_influences, float min_weight) {
+	assert(influences_);
+	auto &influences = *influences_;
+
+	uint32_t most = 0;
+	for (auto &vertex : influences) {
+		std::stable_sort(vertex.begin(), vertex.end(), [](BoneInfluence const &a, BoneInfluence const &b) {
+			return a.weight > b.weight;
+		});
+		if (vertex.size() > max_influences) vertex.resize(max_influences);
+		normalize_weights(&vertex);
+
+		//drop the weakest influences while they are too small to matter (always keeping the strongest):
+		size_t keep = vertex.size();
+		while (keep > 1 && vertex[keep-1].weight < min_weight) --keep;
+		if (keep < vertex.size()) {
+			vertex.resize(keep);
+			normalize_weights(&vertex);
+		}
+
+		most = std::max(most, uint32_t(vertex.size()));
+	}
+	return most;
+}
+
+void quantize_weights_unorm8(std::vector< BoneInfluence > const &influences, uint32_t count, uint8_t *weights) {
+	assert(weights);
+	int total = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		float weight = (i < influences.size() ? influences[i].weight : 0.0f);
+		weights[i] = uint8_t(std::max(0l, std::min(255l, std::lround(weight * 255.0f))));
+		total += weights[i];
+	}
+	//rounding error goes to the strongest influence, so the shader never has to renormalize:
+	if (count > 0 && !influences.empty()) {
+		weights[0] = uint8_t(std::max(0, std::min(255, int(weights[0]) + (255 - total))));
+	}
+}
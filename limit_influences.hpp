@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+//one bone's influence on a vertex:
+struct BoneInfluence {
+	uint32_t bone; //index into the mesh's bones
+	float weight;
+};
+
+//Keep at most 'max_influences' of each vertex's influences -- the strongest ones --
+// drop any that end up below 'min_weight', and renormalize the rest to sum to one.
+//
+// influences - all influences of each vertex, in any order (sorted strongest-first on return)
+//
+// returns the largest number of influences any vertex still has.
+uint32_t limit_influences(std::vector< std::vector< BoneInfluence > > *influences, uint32_t max_influences, float min_weight = 0.0f);
+
+//quantize the first 'count' weights (strongest-first, summing to one) to unorm8 so that they sum to exactly 255:
+// (missing influences get weight 0)
+void quantize_weights_unorm8(std::vector< BoneInfluence > const &influences, uint32_t count, uint8_t *weights);
@@ -0,0 +1,53 @@
+#include "list_directory.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif //WINDOWS
+
+bool is_directory(std::string const &path) {
+	#if defined(_WIN32)
+	DWORD attributes = GetFileAttributesA(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+	#else
+	struct stat info;
+	return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+	#endif
+}
+
+std::vector< std::string > list_directory(std::string const &path) {
+	std::vector< std::string > ret;
+	#if defined(_WIN32)
+	WIN32_FIND_DATAA found;
+	HANDLE handle = FindFirstFileA((path + "\\*").c_str(), &found);
+	if (handle == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to list directory '" + path + "'.");
+	}
+	do {
+		if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+			ret.emplace_back(path + "/" + found.cFileName);
+		}
+	} while (FindNextFileA(handle, &found));
+	FindClose(handle);
+	#else
+	DIR *dir = opendir(path.c_str());
+	if (!dir) {
+		throw std::runtime_error("Failed to list directory '" + path + "'.");
+	}
+	while (struct dirent *entry = readdir(dir)) {
+		std::string file = path + "/" + entry->d_name;
+		struct stat info;
+		if (stat(file.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+			ret.emplace_back(file);
+		}
+	}
+	closedir(dir);
+	#endif
+	std::sort(ret.begin(), ret.end());
+	return ret;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+//true if 'path' names an existing directory:
+bool is_directory(std::string const &path);
+
+//paths of the regular files directly inside directory 'path' (not recursive), sorted by name:
+// note: will throw if the directory can't be read.
+std::vector< std::string > list_directory(std::string const &path);
@@ -0,0 +1,248 @@
+#include "optimize_indices.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+	//number of vertices transformed by a FIFO cache of the given size:
+	size_t count_cache_misses(std::vector< unsigned int > const &indices, size_t vertex_count, unsigned int cache_size) {
+		std::vector< size_t > cached_at(vertex_count, 0); //time stamp the vertex entered the cache, 0 = never
+		size_t time = cache_size + 1;
+		size_t misses = 0;
+		for (auto index : indices) {
+			assert(index < vertex_count);
+			if (cached_at[index] == 0 || time - cached_at[index] > cache_size) {
+				cached_at[index] = time;
+				++time;
+				++misses;
+			}
+		}
+		return misses;
+	}
+}
+
+float compute_acmr(std::vector< unsigned int > const &indices, size_t vertex_count, unsigned int cache_size) {
+	if (indices.size() < 3) return 0.0f;
+	return float(count_cache_misses(indices, vertex_count, cache_size)) / float(indices.size() / 3);
+}
+
+float compute_atvr(std::vector< unsigned int > const &indices, size_t vertex_count, unsigned int cache_size) {
+	std::vector< bool > used(vertex_count, false);
+	size_t unique = 0;
+	for (auto index : indices) {
+		if (!used[index]) {
+			used[index] = true;
+			++unique;
+		}
+	}
+	if (unique == 0) return 0.0f;
+	return float(count_cache_misses(indices, vertex_count, cache_size)) / float(unique);
+}
+
+void optimize_vertex_cache(std::vector< unsigned int > *indices_, size_t vertex_count, unsigned int cache_size, std::vector< size_t > *clusters, float split_threshold) {
+	assert(indices_);
+	auto &indices = *indices_;
+	assert(indices.size() % 3 == 0);
+	size_t triangle_count = indices.size() / 3;
+	if (clusters) clusters->clear();
+	if (triangle_count == 0) return;
+
+	//vertex -> triangle adjacency, as offsets into one array:
+	std::vector< unsigned int > live(vertex_count, 0); //triangles not yet emitted, per vertex
+	for (auto index : indices) {
+		assert(index < vertex_count);
+		++live[index];
+	}
+	std::vector< size_t > adjacency_begin(vertex_count + 1, 0);
+	for (size_t v = 0; v < vertex_count; ++v) {
+		adjacency_begin[v + 1] = adjacency_begin[v] + live[v];
+	}
+	std::vector< unsigned int > adjacency(indices.size());
+	{
+		std::vector< size_t > fill(adjacency_begin.begin(), adjacency_begin.end() - 1);
+		for (size_t t = 0; t < triangle_count; ++t) {
+			for (size_t c = 0; c < 3; ++c) {
+				adjacency[fill[indices[3*t+c]]++] = unsigned(t);
+			}
+		}
+	}
+
+	std::vector< size_t > cached_at(vertex_count, 0);
+	std::vector< bool > emitted(triangle_count, false);
+	std::vector< unsigned int > dead_end; //recently used vertices, to restart from when fanning runs dry
+	std::vector< unsigned int > output;
+	output.reserve(indices.size());
+
+	size_t time = cache_size + 1;
+	size_t cursor = 0; //vertices below this have no live triangles left
+	long fanning = 0;
+	while (fanning < long(vertex_count) && live[fanning] == 0) ++fanning;
+	if (clusters) clusters->emplace_back(0);
+
+	std::vector< unsigned int > candidates;
+	while (fanning >= 0 && fanning < long(vertex_count)) {
+		//emit all remaining triangles around the fanning vertex:
+		candidates.clear();
+		for (size_t a = adjacency_begin[fanning]; a < adjacency_begin[fanning + 1]; ++a) {
+			unsigned int t = adjacency[a];
+			if (emitted[t]) continue;
+			emitted[t] = true;
+			for (size_t c = 0; c < 3; ++c) {
+				unsigned int v = indices[3*t+c];
+				output.emplace_back(v);
+				dead_end.emplace_back(v);
+				candidates.emplace_back(v);
+				--live[v];
+				if (time - cached_at[v] > cache_size) {
+					cached_at[v] = time;
+					++time;
+				}
+			}
+		}
+
+		//next fanning vertex: the candidate that will stay in cache longest while its fan is emitted
+		long best = -1;
+		long best_priority = -1;
+		for (auto v : candidates) {
+			if (live[v] == 0) continue;
+			long priority = 0;
+			if (long(time - cached_at[v]) + 2 * long(live[v]) <= long(cache_size)) {
+				priority = long(time - cached_at[v]);
+			}
+			if (priority > best_priority) {
+				best_priority = priority;
+				best = v;
+			}
+		}
+
+		if (best == -1) {
+			//dead end: restart from a recently used vertex, or else the next unfinished vertex
+			while (!dead_end.empty()) {
+				unsigned int v = dead_end.back();
+				dead_end.pop_back();
+				if (live[v] > 0) {
+					best = v;
+					break;
+				}
+			}
+			if (best == -1) {
+				while (cursor < vertex_count && live[cursor] == 0) ++cursor;
+				if (cursor < vertex_count) best = long(cursor);
+			}
+			if (best != -1 && clusters) clusters->emplace_back(output.size() / 3);
+		}
+		fanning = best;
+	}
+
+	assert(output.size() == indices.size());
+	indices = std::move(output);
+
+	if (clusters && split_threshold > 0.0f) {
+		//soft boundaries: replay each cluster as if drawn on its own and cut it wherever its ACMR
+		// so far is already below the threshold, since starting over there costs little cache efficiency
+		float threshold = split_threshold * compute_acmr(indices, vertex_count, cache_size);
+		std::vector< size_t > split;
+		std::fill(cached_at.begin(), cached_at.end(), 0);
+		time = cache_size + 1;
+		for (size_t i = 0; i < clusters->size(); ++i) {
+			size_t begin = (*clusters)[i];
+			size_t end = (i + 1 < clusters->size() ? (*clusters)[i+1] : triangle_count);
+			split.emplace_back(begin);
+			time += cache_size + 1; //every cluster starts from a cold cache
+			size_t misses = 0;
+			size_t triangles = 0;
+			for (size_t t = begin; t < end; ++t) {
+				for (size_t c = 0; c < 3; ++c) {
+					unsigned int v = indices[3*t+c];
+					if (time - cached_at[v] > cache_size) {
+						cached_at[v] = time;
+						++time;
+						++misses;
+					}
+				}
+				++triangles;
+				if (t + 1 < end && float(misses) < threshold * float(triangles)) {
+					split.emplace_back(t + 1);
+					time += cache_size + 1;
+					misses = 0;
+					triangles = 0;
+				}
+			}
+		}
+		*clusters = std::move(split);
+	}
+}
+
+void optimize_overdraw(std::vector< unsigned int > *indices_, std::vector< float > const &positions, std::vector< size_t > const &clusters) {
+	assert(indices_);
+	auto &indices = *indices_;
+	size_t triangle_count = indices.size() / 3;
+	if (clusters.size() <= 1) return;
+
+	auto position = [&positions](unsigned int v) {
+		return glm::vec3(positions[3*v+0], positions[3*v+1], positions[3*v+2]);
+	};
+
+	//area-weighted mesh centroid:
+	glm::vec3 mesh_center(0.0f);
+	float mesh_area = 0.0f;
+	for (size_t t = 0; t < triangle_count; ++t) {
+		glm::vec3 a = position(indices[3*t+0]), b = position(indices[3*t+1]), c = position(indices[3*t+2]);
+		float area = glm::length(glm::cross(b - a, c - a));
+		mesh_center += (a + b + c) * (area / 3.0f);
+		mesh_area += area;
+	}
+	if (mesh_area > 0.0f) mesh_center = mesh_center / mesh_area;
+
+	//sort key per cluster: how much the cluster faces away from the center of the mesh
+	struct Cluster {
+		size_t begin, end;
+		float sort_key;
+	};
+	std::vector< Cluster > sorted;
+	for (size_t i = 0; i < clusters.size(); ++i) {
+		Cluster cluster;
+		cluster.begin = clusters[i];
+		cluster.end = (i + 1 < clusters.size() ? clusters[i+1] : triangle_count);
+		glm::vec3 center(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = cluster.begin; t < cluster.end; ++t) {
+			glm::vec3 a = position(indices[3*t+0]), b = position(indices[3*t+1]), c = position(indices[3*t+2]);
+			glm::vec3 n = glm::cross(b - a, c - a);
+			float tri_area = glm::length(n);
+			center += (a + b + c) * (tri_area / 3.0f);
+			normal += n;
+			area += tri_area;
+		}
+		if (area > 0.0f) center = center / area;
+		float normal_length = glm::length(normal);
+		cluster.sort_key = (normal_length > 0.0f ? glm::dot(center - mesh_center, normal / normal_length) : 0.0f);
+		sorted.emplace_back(cluster);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](Cluster const &a, Cluster const &b) {
+		return a.sort_key > b.sort_key;
+	});
+
+	std::vector< unsigned int > output;
+	output.reserve(indices.size());
+	for (auto const &cluster : sorted) {
+		output.insert(output.end(), indices.begin() + 3 * cluster.begin, indices.begin() + 3 * cluster.end);
+	}
+	indices = std::move(output);
+}
+
+std::vector< unsigned int > optimize_vertex_fetch(std::vector< unsigned int > *indices_, size_t vertex_count, size_t *new_vertex_count) {
+	assert(indices_);
+	assert(new_vertex_count);
+	auto &indices = *indices_;
+
+	std::vector< unsigned int > remap(vertex_count, ~0u);
+	unsigned int next = 0;
+	for (auto &index : indices) {
+		assert(index < vertex_count);
+		if (remap[index] == ~0u) remap[index] = next++;
+		index = remap[index];
+	}
+	*new_vertex_count = next;
+	return remap;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+//Index / vertex buffer reordering for the GPU's post-transform vertex cache and vertex fetch.
+// used by the exporter; all functions expect triangle lists.
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+#include <cassert>
+
+//cache size assumed by the optimizer and by the statistics below:
+constexpr unsigned int VertexCacheSize = 16;
+
+//average cache miss ratio: transformed vertices per triangle (0.5 is ideal for large grids, 3 is worst):
+float compute_acmr(std::vector< unsigned int > const &indices, size_t vertex_count, unsigned int cache_size = VertexCacheSize);
+
+//average transform to vertex ratio: transformed vertices per referenced vertex (1 is ideal):
+float compute_atvr(std::vector< unsigned int > const &indices, size_t vertex_count, unsigned int cache_size = VertexCacheSize);
+
+//reorder triangles for vertex cache locality ("Tipsify", Sander, Nehab & Barczak 2007):
+// if 'clusters' is given, it receives the triangle index at which each run of
+// cache-coherent triangles starts (useful for optimize_overdraw). Runs end where the fan
+// walk hits a dead end, and are also split wherever a run's own ACMR so far (from a cold cache)
+// drops below 'split_threshold' x the ACMR of the whole result; larger values give more,
+// smaller clusters (less overdraw, more cache misses once sorted), 0 splits only at dead ends.
+void optimize_vertex_cache(std::vector< unsigned int > *indices, size_t vertex_count,
+	unsigned int cache_size = VertexCacheSize, std::vector< size_t > *clusters = nullptr, float split_threshold = 1.05f);
+
+//reorder the clusters produced by optimize_vertex_cache so that outward-facing clusters draw first,
+// which tends to reduce overdraw from any viewpoint while keeping cache order inside each cluster:
+// positions - three floats per vertex
+void optimize_overdraw(std::vector< unsigned int > *indices, std::vector< float > const &positions,
+	std::vector< size_t > const &clusters);
+
+//renumber vertices in the order the (already cache-optimized) index buffer first uses them,
+// so vertex fetch walks the vertex buffer roughly linearly:
+// rewrites 'indices' and returns the new number of each old vertex (~0u for vertices no triangle uses)
+std::vector< unsigned int > optimize_vertex_fetch(std::vector< unsigned int > *indices, size_t vertex_count, size_t *new_vertex_count);
+
+//apply a remap from optimize_vertex_fetch to a per-vertex array holding 'stride' elements per vertex:
+template< typename T >
+void remap_vertices(std::vector< T > *data_, std::vector< unsigned int > const &remap, size_t new_vertex_count, size_t stride = 1) {
+	assert(data_);
+	auto &data = *data_;
+	assert(data.size() == remap.size() * stride);
+	std::vector< T > remapped(new_vertex_count * stride);
+	for (size_t v = 0; v < remap.size(); ++v) {
+		if (remap[v] == ~0u) continue;
+		for (size_t e = 0; e < stride; ++e) {
+			remapped[remap[v] * stride + e] = data[v * stride + e];
+		}
+	}
+	data = std::move(remapped);
+}
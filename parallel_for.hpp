@@ -0,0 +1,50 @@
+#pragma once
+
+//Run a function over a range of items on a small pool of threads.
+// used by the exporter to process assets (and meshes within an asset) concurrently.
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+
+//call fn(i) for every i in [0, count), using up to 'threads' threads (including the calling thread):
+// items are handed out one at a time, so uneven items still balance out.
+// fn must be safe to call concurrently; the first exception thrown by fn is rethrown here after all threads finish.
+template< typename F >
+void parallel_for(size_t count, unsigned int threads, F const &fn) {
+	if (threads <= 1 || count <= 1) {
+		for (size_t i = 0; i < count; ++i) fn(i);
+		return;
+	}
+
+	std::atomic< size_t > next(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	auto work = [&]() {
+		for (size_t i = next++; i < count; i = next++) {
+			try {
+				fn(i);
+			} catch (...) {
+				std::lock_guard< std::mutex > lock(error_mutex);
+				if (!error) error = std::current_exception();
+			}
+		}
+	};
+
+	std::vector< std::thread > pool;
+	for (unsigned int t = 1; t < threads && t < count; ++t) {
+		pool.emplace_back(work);
+	}
+	work();
+	for (auto &thread : pool) thread.join();
+	if (error) std::rethrow_exception(error);
+}
+
+//number of threads to use by default:
+inline unsigned int default_thread_count() {
+	unsigned int threads = std::thread::hardware_concurrency();
+	return (threads == 0 ? 1 : threads);
+}
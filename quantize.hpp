@@ -0,0 +1,145 @@
+#pragma once
+
+//helper functions for packing floats / quaternions into small fixed-point values.
+// used by the exporter to encode and by the runtime to decode, so the two always agree.
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+//map value in [min, min+extent] to [0, 65535]:
+inline uint16_t quantize_unorm16(float value, float min, float extent) {
+	if (extent <= 0.0f) return 0;
+	float t = (value - min) / extent;
+	t = std::max(0.0f, std::min(1.0f, t));
+	return uint16_t(std::lround(t * 65535.0f));
+}
+
+inline float dequantize_unorm16(uint16_t value, float min, float extent) {
+	return min + extent * (float(value) * (1.0f / 65535.0f));
+}
+
+//IEEE half float (as uploaded with GL_HALF_FLOAT), rounded to nearest even; out-of-range values become infinity:
+inline uint16_t pack_half(float value) {
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t mantissa = bits & 0x7fffff;
+	if (((bits >> 23) & 0xff) == 0xff) return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0)); //inf / nan
+	int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+	if (exponent >= 31) return uint16_t(sign | 0x7c00);
+	uint32_t shift = 13;
+	uint32_t half = 0;
+	if (exponent <= 0) {
+		//subnormal (or zero): shift the mantissa, with its implicit leading one, down to 2^-24 units
+		if (exponent < -10) return uint16_t(sign);
+		mantissa |= 0x800000;
+		shift = uint32_t(14 - exponent);
+	} else {
+		half = uint32_t(exponent) << 10;
+	}
+	half |= mantissa >> shift;
+	uint32_t rest = mantissa & ((1u << shift) - 1);
+	uint32_t halfway = 1u << (shift - 1);
+	if (rest > halfway || (rest == halfway && (half & 1))) ++half; //(a carry into the exponent is still correct)
+	return uint16_t(sign | half);
+}
+
+//"smallest three" quaternion packing:
+// the largest-magnitude component is dropped (and made positive, since q and -q are the same rotation),
+// the other three lie in [-1/sqrt(2), 1/sqrt(2)] and are stored in 15 bits each,
+// with the dropped component's index in the top 2 bits: 2 + 3*15 = 47 of 48 bits.
+struct PackedQuat {
+	uint16_t bits[3];
+};
+static_assert(sizeof(PackedQuat) == 6, "PackedQuat is packed");
+
+constexpr float PackedQuatRange = 0.70710678118f; //1/sqrt(2)
+
+inline PackedQuat pack_quat(glm::quat const &q_) {
+	glm::quat q = glm::normalize(q_);
+	float c[4] = {q.x, q.y, q.z, q.w};
+
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; ++i) {
+		if (std::abs(c[i]) > std::abs(c[largest])) largest = i;
+	}
+	float sign = (c[largest] < 0.0f ? -1.0f : 1.0f);
+
+	uint64_t packed = uint64_t(largest) << 45;
+	uint32_t shift = 30;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		float t = (sign * c[i] / PackedQuatRange) * 0.5f + 0.5f;
+		t = std::max(0.0f, std::min(1.0f, t));
+		packed |= uint64_t(std::lround(t * 32767.0f)) << shift;
+		shift -= 15;
+	}
+
+	PackedQuat ret;
+	ret.bits[0] = uint16_t(packed >> 32);
+	ret.bits[1] = uint16_t(packed >> 16);
+	ret.bits[2] = uint16_t(packed);
+	return ret;
+}
+
+inline glm::quat unpack_quat(PackedQuat const &p) {
+	uint64_t packed = (uint64_t(p.bits[0]) << 32) | (uint64_t(p.bits[1]) << 16) | uint64_t(p.bits[2]);
+	uint32_t largest = uint32_t(packed >> 45) & 3;
+
+	float c[4];
+	float sum = 0.0f;
+	uint32_t shift = 30;
+	for (uint32_t i = 0; i < 4; ++i) {
+		if (i == largest) continue;
+		float t = float((packed >> shift) & 0x7fff) * (1.0f / 32767.0f);
+		c[i] = (t * 2.0f - 1.0f) * PackedQuatRange;
+		sum += c[i] * c[i];
+		shift -= 15;
+	}
+	c[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+
+	return glm::quat(c[3], c[0], c[1], c[2]);
+}
+
+//octahedral normal packing (Meyer et al. 2010, "On Floating-Point Normal Vectors"):
+// the unit sphere is projected onto an octahedron, which is unfolded into the [-1,1]^2 square,
+// stored as two snorm16 values. (decoded by the skinning shader, see oct_decode in PlayMode.cpp)
+struct PackedNormal {
+	int16_t v[2];
+};
+static_assert(sizeof(PackedNormal) == 4, "PackedNormal is packed");
+
+inline PackedNormal pack_normal(glm::vec3 const &n) {
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	float x = (l1 > 0.0f ? n.x / l1 : 0.0f);
+	float y = (l1 > 0.0f ? n.y / l1 : 0.0f);
+	if (n.z < 0.0f) {
+		//fold the lower hemisphere over the diagonals:
+		float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = fx;
+		y = fy;
+	}
+	PackedNormal ret;
+	ret.v[0] = int16_t(std::lround(std::max(-1.0f, std::min(1.0f, x)) * 32767.0f));
+	ret.v[1] = int16_t(std::lround(std::max(-1.0f, std::min(1.0f, y)) * 32767.0f));
+	return ret;
+}
+
+inline glm::vec3 unpack_normal(PackedNormal const &p) {
+	float x = std::max(-1.0f, float(p.v[0]) / 32767.0f);
+	float y = std::max(-1.0f, float(p.v[1]) / 32767.0f);
+	float z = 1.0f - std::abs(x) - std::abs(y);
+	if (z < 0.0f) {
+		float ux = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float uy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = ux;
+		y = uy;
+	}
+	return glm::normalize(glm::vec3(x, y, z));
+}
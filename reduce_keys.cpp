@@ -0,0 +1,100 @@
+#include "reduce_keys.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+	//distance-like error between two poses of the same channel:
+	float key_error(TRSKey const &a, glm::vec3 const &a_scale, TRSKey const &b, glm::vec3 const &b_scale, float radius) {
+		float cos_half = std::min(1.0f, std::abs(glm::dot(a.rotation, b.rotation)));
+		float angle = 2.0f * std::acos(cos_half);
+		float error = glm::length(a.translation - b.translation);
+		error = std::max(error, angle * radius);
+		error = std::max(error, glm::length(a_scale - b_scale) * radius);
+		return error;
+	}
+}
+
+void reduce_keys(float max_error, float radius,
+	std::vector< TRSKey > *keys_, std::vector< glm::vec3 > *scales_, std::vector< uint16_t > *frames_,
+	QuantizedRange const *quantized) {
+	assert(keys_ && scales_ && frames_);
+	auto &keys = *keys_;
+	auto &scales = *scales_;
+	auto &frames = *frames_;
+	assert(frames.size() == keys.size());
+	assert(scales.empty() || scales.size() == keys.size());
+
+	if (keys.size() <= 2) return;
+
+	auto scale_at = [&](size_t i) {
+		return scales.empty() ? glm::vec3(1.0f) : scales[i];
+	};
+
+	//keys as they will be decoded, for the ends of each span (errors are still measured against the exact keys):
+	std::vector< TRSKey > decoded = keys;
+	std::vector< glm::vec3 > decoded_scales = scales;
+	if (quantized) {
+		auto round_trip = [](glm::vec3 const &v, glm::vec3 const &min, glm::vec3 const &extent) {
+			glm::vec3 ret;
+			for (int c = 0; c < 3; ++c) {
+				ret[c] = dequantize_unorm16(quantize_unorm16(v[c], min[c], extent[c]), min[c], extent[c]);
+			}
+			return ret;
+		};
+		for (size_t i = 0; i < keys.size(); ++i) {
+			decoded[i].rotation = unpack_quat(pack_quat(keys[i].rotation));
+			decoded[i].translation = round_trip(keys[i].translation, quantized->translation_min, quantized->translation_extent);
+			if (!scales.empty()) decoded_scales[i] = round_trip(scales[i], quantized->scale_min, quantized->scale_extent);
+		}
+	}
+	auto decoded_scale_at = [&](size_t i) {
+		return decoded_scales.empty() ? glm::vec3(1.0f) : decoded_scales[i];
+	};
+
+	//constant channel: one key is enough
+	bool constant = true;
+	for (size_t i = 0; i < keys.size() && constant; ++i) {
+		constant = key_error(decoded[0], decoded_scale_at(0), keys[i], scale_at(i), radius) <= max_error;
+	}
+	if (constant) {
+		keys.resize(1);
+		frames.resize(1);
+		if (!scales.empty()) scales.resize(1);
+		return;
+	}
+
+	//does interpolating from key 'a' to key 'b' reproduce every key in between?
+	auto span_ok = [&](size_t a, size_t b) {
+		for (size_t i = a + 1; i < b; ++i) {
+			float t = float(frames[i] - frames[a]) / float(frames[b] - frames[a]);
+			TRSKey interp;
+			interp.rotation = glm::slerp(decoded[a].rotation, decoded[b].rotation, t);
+			interp.translation = glm::mix(decoded[a].translation, decoded[b].translation, t);
+			glm::vec3 interp_scale = glm::mix(decoded_scale_at(a), decoded_scale_at(b), t);
+			if (key_error(interp, interp_scale, keys[i], scale_at(i), radius) > max_error) return false;
+		}
+		return true;
+	};
+
+	//greedy: from each kept key, extend the span as far as interpolation stays within error
+	std::vector< size_t > kept;
+	kept.emplace_back(0);
+	size_t a = 0;
+	while (a + 1 < keys.size()) {
+		size_t b = a + 1;
+		while (b + 1 < keys.size() && span_ok(a, b + 1)) ++b;
+		kept.emplace_back(b);
+		a = b;
+	}
+
+	for (size_t k = 0; k < kept.size(); ++k) {
+		keys[k] = keys[kept[k]];
+		frames[k] = frames[kept[k]];
+		if (!scales.empty()) scales[k] = scales[kept[k]];
+	}
+	keys.resize(kept.size());
+	frames.resize(kept.size());
+	if (!scales.empty()) scales.resize(kept.size());
+}
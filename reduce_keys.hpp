@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Skeletal.hpp"
+
+#include <vector>
+#include <cstdint>
+
+//Drop animation keys that interpolating between the surrounding kept keys reproduces
+// to within 'max_error', and fold channels that never move beyond 'max_error' down to one key.
+//
+// keys, frames - one channel's keys and the frame each key sits on (modified in place)
+// scales - the channel's scale keys, or empty if it has none (modified in place)
+// radius - distance used to turn rotation / scale error into a distance: the farthest point
+//          the channel's node moves (descendants, skinned vertices), so max_error bounds model space error
+//
+// quantized - if the keys will be stored quantized (see quantize.hpp), the range they will be
+//          stored relative to: kept keys are then interpolated as the runtime will decode them
+//          (smallest-three rotations, 16 bit translation / scale), so 'max_error' bounds the error
+//          of reduction and quantization together rather than reduction alone.
+//
+// the first and last key are always kept (unless the whole channel folds to one key).
+void reduce_keys(float max_error, float radius,
+	std::vector< TRSKey > *keys, std::vector< glm::vec3 > *scales, std::vector< uint16_t > *frames,
+	QuantizedRange const *quantized = nullptr);
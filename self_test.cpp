@@ -0,0 +1,226 @@
+#include "self_test.hpp"
+
+#include "buffer_codec.hpp"
+#include "quantize.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+	//small deterministic generator, so a failure reproduces run to run:
+	struct Random {
+		uint32_t state = 12345;
+		uint32_t next() {
+			state = state * 1664525u + 1013904223u;
+			return state >> 8; //(24 bits)
+		}
+		float unit() { return float(next()) / float(1u << 24); } //[0,1)
+		float signed_unit() { return unit() * 2.0f - 1.0f; } //[-1,1)
+	};
+
+	struct Checker {
+		Checker(std::ostream &log_) : log(log_) { }
+		std::ostream &log;
+		uint32_t checks = 0;
+		uint32_t failures = 0;
+		void check(bool ok, std::string const &what) {
+			++checks;
+			if (ok) return;
+			++failures;
+			if (failures <= 20) log << "FAILED: " << what << std::endl;
+			else if (failures == 21) log << "(further failures not printed)" << std::endl;
+		}
+	};
+
+	//IEEE half float to float (the inverse of pack_half, as GL does it):
+	float unpack_half(uint16_t half) {
+		uint32_t sign = uint32_t(half & 0x8000) << 16;
+		uint32_t exponent = (half >> 10) & 0x1f;
+		uint32_t mantissa = half & 0x3ff;
+		uint32_t bits;
+		if (exponent == 0x1f) {
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		} else if (exponent != 0) {
+			bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+		} else if (mantissa != 0) {
+			//subnormal: mantissa x 2^-24
+			float value = float(mantissa) * (1.0f / 16777216.0f);
+			return (sign ? -value : value);
+		} else {
+			bits = sign;
+		}
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	//decoded triangles must be the originals in order, each possibly rotated (winding kept):
+	bool same_triangles(std::vector< unsigned int > const &a, std::vector< unsigned int > const &b) {
+		if (a.size() != b.size()) return false;
+		for (size_t t = 0; t + 2 < a.size(); t += 3) {
+			bool found = false;
+			for (size_t r = 0; r < 3 && !found; ++r) {
+				found = (b[t+0] == a[t + r]) && (b[t+1] == a[t + (r + 1) % 3]) && (b[t+2] == a[t + (r + 2) % 3]);
+			}
+			if (!found) return false;
+		}
+		return true;
+	}
+
+	std::vector< unsigned int > const VertexCounts = {0, 1, 15, 16, 17, 256, 257};
+
+	void test_index_codec(Checker &checker, Random &random) {
+		for (unsigned int base : {0u, 65530u, 1u << 24, 0xffffffffu - 300u}) {
+			for (unsigned int count : VertexCounts) {
+				std::string name = std::to_string(count) + " vertices from " + std::to_string(base);
+
+				//strip, alternating winding like a triangle strip's:
+				std::vector< unsigned int > strip;
+				for (unsigned int v = 0; v + 2 < count; ++v) {
+					if (v % 2) strip.insert(strip.end(), {base + v + 1, base + v, base + v + 2});
+					else strip.insert(strip.end(), {base + v, base + v + 1, base + v + 2});
+				}
+
+				//degenerate triangles (repeated vertices, repeated triangles):
+				std::vector< unsigned int > degenerate;
+				if (count >= 1) degenerate.insert(degenerate.end(), {base, base, base, base, base, base});
+				if (count >= 2) degenerate.insert(degenerate.end(), {base, base + 1, base + 1, base + 1, base, base + 1, base + 1, base + 1, base});
+				if (count >= 3) degenerate.insert(degenerate.end(), {base + 2, base, base + 2, base + count - 1, base + count - 1, base});
+
+				//soup: random triangles over all the vertices (for small counts, mostly degenerate):
+				std::vector< unsigned int > soup;
+				for (unsigned int t = 0; count > 0 && t < 2 * count; ++t) {
+					for (int c = 0; c < 3; ++c) soup.emplace_back(base + random.next() % count);
+				}
+
+				std::vector< unsigned int > mixed = strip;
+				mixed.insert(mixed.end(), degenerate.begin(), degenerate.end());
+				mixed.insert(mixed.end(), soup.begin(), soup.end());
+				mixed.insert(mixed.end(), strip.begin(), strip.end());
+
+				for (auto const &test : {std::make_pair("strip", &strip), std::make_pair("degenerate", &degenerate),
+					std::make_pair("soup", &soup), std::make_pair("mixed", &mixed)}) {
+					bool ok = false;
+					try {
+						ok = same_triangles(*test.second, decode_index_buffer(encode_index_buffer(*test.second)));
+					} catch (std::exception const &e) {
+						checker.log << "(" << e.what() << ")" << std::endl;
+					}
+					checker.check(ok, std::string("index codec, ") + test.first + " over " + name);
+				}
+			}
+		}
+	}
+
+	void test_vertex_codec(Checker &checker, Random &random) {
+		for (unsigned int count : VertexCounts) {
+			for (size_t stride = 1; stride <= 56; ++stride) {
+				std::vector< uint8_t > smooth(count * stride), noise(count * stride), constant(count * stride, 0xa5);
+				for (size_t i = 0; i < count; ++i) {
+					for (size_t k = 0; k < stride; ++k) {
+						smooth[i * stride + k] = uint8_t(i * (k + 1) / 3 + k);
+						noise[i * stride + k] = uint8_t(random.next());
+					}
+				}
+				for (auto const &test : {std::make_pair("smooth", &smooth), std::make_pair("noise", &noise), std::make_pair("constant", &constant)}) {
+					std::vector< uint8_t > decoded;
+					size_t decoded_stride = 0;
+					bool ok = false;
+					try {
+						decode_vertex_buffer(encode_vertex_buffer(test.second->data(), count, stride), &decoded, &decoded_stride);
+						ok = (decoded_stride == stride && decoded == *test.second);
+					} catch (std::exception const &e) {
+						checker.log << "(" << e.what() << ")" << std::endl;
+					}
+					checker.check(ok, std::string("vertex codec, ") + test.first + ", " + std::to_string(count) + " vertices of stride " + std::to_string(stride));
+				}
+			}
+		}
+	}
+
+	void test_quats(Checker &checker, Random &random) {
+		float const h = 0.70710678f;
+		std::vector< glm::quat > quats = {
+			glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::quat(-1.0f, 0.0f, 0.0f, 0.0f),
+			glm::quat(0.0f, 1.0f, 0.0f, 0.0f), glm::quat(0.0f, 0.0f, 0.0f, -1.0f),
+			glm::quat(0.5f, 0.5f, 0.5f, 0.5f), glm::quat(0.5f, -0.5f, 0.5f, -0.5f),
+			glm::quat(h, h, 0.0f, 0.0f), glm::quat(0.0f, 0.0f, -h, h), //(two largest components tie)
+		};
+		while (quats.size() < 10000) {
+			glm::quat q(random.signed_unit(), random.signed_unit(), random.signed_unit(), random.signed_unit());
+			if (glm::length(q) > 0.01f) quats.emplace_back(glm::normalize(q));
+		}
+		//15 bits over [-1/sqrt(2), 1/sqrt(2)]: half a step is ~2.2e-5 per stored component
+		float max_error = 0.0f;
+		for (auto const &q : quats) {
+			glm::quat r = unpack_quat(pack_quat(q));
+			float sign = (glm::dot(q, r) < 0.0f ? -1.0f : 1.0f);
+			float error = std::max(std::max(std::abs(q.x - sign * r.x), std::abs(q.y - sign * r.y)),
+				std::max(std::abs(q.z - sign * r.z), std::abs(q.w - sign * r.w)));
+			max_error = std::max(max_error, error);
+		}
+		checker.check(max_error < 1e-4f, "smallest-three quaternions, max component error " + std::to_string(max_error));
+	}
+
+	void test_half(Checker &checker, Random &random) {
+		//every half is exactly a float, and packs back to itself:
+		uint32_t mismatches = 0;
+		for (uint32_t bits = 0; bits < 0x10000; ++bits) {
+			float value = unpack_half(uint16_t(bits));
+			uint16_t packed = pack_half(value);
+			if (std::isnan(value) ? !std::isnan(unpack_half(packed)) : packed != bits) ++mismatches;
+		}
+		checker.check(mismatches == 0, "half floats, " + std::to_string(mismatches) + " of 65536 don't round-trip");
+
+		//other floats round to within half a step (relative 2^-11, or 2^-25 among the subnormals):
+		mismatches = 0;
+		for (uint32_t i = 0; i < 100000; ++i) {
+			float value = random.signed_unit() * std::ldexp(1.0f, int(random.next() % 44) - 28);
+			float decoded = unpack_half(pack_half(value));
+			bool ok;
+			if (std::abs(value) >= 65520.0f) {
+				ok = std::isinf(decoded) && ((decoded < 0.0f) == (value < 0.0f));
+			} else {
+				ok = std::abs(decoded - value) <= std::max(std::abs(value) * (1.0f / 2048.0f), 1.0f / 33554432.0f);
+			}
+			if (!ok) ++mismatches;
+		}
+		checker.check(mismatches == 0, "half floats, " + std::to_string(mismatches) + " of 100000 floats round badly");
+	}
+
+	void test_normals(Checker &checker, Random &random) {
+		std::vector< glm::vec3 > normals = {
+			glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+			glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+			glm::normalize(glm::vec3(1.0f, 1.0f, 1.0f)), glm::normalize(glm::vec3(-1.0f, -1.0f, -1.0f)),
+			glm::normalize(glm::vec3(1.0f, -1.0f, 0.0f)), glm::normalize(glm::vec3(0.0f, 1.0f, -1.0f)),
+		};
+		while (normals.size() < 10000) {
+			glm::vec3 n(random.signed_unit(), random.signed_unit(), random.signed_unit());
+			if (glm::length(n) > 0.01f) normals.emplace_back(glm::normalize(n));
+		}
+		//snorm16 on the octahedron: well under a milliradian anywhere on the sphere
+		float min_dot = 1.0f;
+		for (auto const &n : normals) {
+			min_dot = std::min(min_dot, glm::dot(n, unpack_normal(pack_normal(n))));
+		}
+		checker.check(min_dot > 0.999999f, "octahedral normals, min dot with original " + std::to_string(min_dot));
+	}
+}
+
+bool run_self_test(std::ostream &log) {
+	Checker checker(log);
+	Random random;
+	test_index_codec(checker, random);
+	test_vertex_codec(checker, random);
+	test_quats(checker, random);
+	test_half(checker, random);
+	test_normals(checker, random);
+	log << "Self test: " << checker.checks << " checks, " << checker.failures << " failed" << std::endl;
+	return checker.failures == 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <ostream>
+
+//Round-trip checks for the exporter's encodings, run by "export -selftest":
+// - index codec: strips, triangle soups and degenerate triangles over 0, 1, 15, 16, 17, 256 and 257
+//   vertices, with indices based at 0 and well past 65535;
+// - vertex codec: the same vertex counts at every stride from 1 to 56 bytes;
+// - smallest-three quaternions, half floats and octahedral normals, against their precision.
+//
+// prints each failure (and a summary) to 'log'; returns true if every check passed.
+bool run_self_test(std::ostream &log);
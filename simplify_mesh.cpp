@@ -0,0 +1,270 @@
+#include "simplify_mesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <map>
+#include <queue>
+#include <tuple>
+
+namespace {
+	//symmetric 4x4 matrix: the (area-weighted) sum of squared distances to a set of planes, as a function of position
+	struct Quadric {
+		double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+		double weight = 0;
+
+		void add_plane(glm::vec3 const &n_, double d, double w) {
+			double x = n_.x, y = n_.y, z = n_.z;
+			a2 += w * x * x; ab += w * x * y; ac += w * x * z; ad += w * x * d;
+			b2 += w * y * y; bc += w * y * z; bd += w * y * d;
+			c2 += w * z * z; cd += w * z * d;
+			d2 += w * d * d;
+			weight += w;
+		}
+		void add(Quadric const &o) {
+			a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+			b2 += o.b2; bc += o.bc; bd += o.bd;
+			c2 += o.c2; cd += o.cd;
+			d2 += o.d2;
+			weight += o.weight;
+		}
+		double error(glm::vec3 const &p_) const {
+			double px = p_.x, py = p_.y, pz = p_.z;
+			double e = a2 * px * px + 2.0 * ab * px * py + 2.0 * ac * px * pz + 2.0 * ad * px
+				+ b2 * py * py + 2.0 * bc * py * pz + 2.0 * bd * py
+				+ c2 * pz * pz + 2.0 * cd * pz
+				+ d2;
+			//mean rather than sum, so the error stays a squared distance however many planes were merged:
+			return (weight > 0.0 ? std::max(0.0, e) / weight : 0.0);
+		}
+	};
+
+	struct Simplifier {
+		std::vector< glm::vec3 > positions;
+		std::vector< std::vector< BoneInfluence > > const &influences;
+		double weight_error_scale;
+
+		std::vector< unsigned int > triangles; //three per triangle; removed triangles stay, marked dead
+		std::vector< bool > dead;
+		size_t live_triangles = 0;
+		std::vector< std::vector< uint32_t > > vertex_triangles; //triangles using each vertex (may list dead ones)
+		std::vector< Quadric > quadrics;
+		std::vector< bool > locked;
+		std::vector< uint32_t > collapsed_into; //for each vertex, itself or the vertex it was collapsed onto
+		std::vector< uint32_t > version; //bumped whenever a vertex's neighborhood changes, to skip stale queue entries
+		double max_error = 0.0; //largest collapse cost so far (squared distance)
+
+		struct Candidate {
+			double cost;
+			uint32_t from, to, version;
+			bool operator<(Candidate const &o) const { return cost > o.cost; } //min-heap
+		};
+		std::priority_queue< Candidate > queue;
+
+		Simplifier(std::vector< unsigned int > const &indices, std::vector< float > const &positions_,
+			std::vector< std::vector< BoneInfluence > > const &influences_, double weight_error_scale_)
+			: influences(influences_), weight_error_scale(weight_error_scale_), triangles(indices) {
+			size_t vertex_count = positions_.size() / 3;
+			positions.resize(vertex_count);
+			for (size_t v = 0; v < vertex_count; ++v) {
+				positions[v] = glm::vec3(positions_[3*v+0], positions_[3*v+1], positions_[3*v+2]);
+			}
+			size_t triangle_count = triangles.size() / 3;
+			dead.assign(triangle_count, false);
+			live_triangles = triangle_count;
+			vertex_triangles.resize(vertex_count);
+			quadrics.resize(vertex_count);
+			locked.assign(vertex_count, false);
+			version.assign(vertex_count, 0);
+			collapsed_into.resize(vertex_count);
+			for (size_t v = 0; v < vertex_count; ++v) collapsed_into[v] = uint32_t(v);
+
+			//plane quadrics, and edge use counts to find open borders:
+			std::map< std::pair< uint32_t, uint32_t >, uint32_t > edge_uses;
+			for (size_t t = 0; t < triangle_count; ++t) {
+				uint32_t v[3] = {triangles[3*t+0], triangles[3*t+1], triangles[3*t+2]};
+				for (size_t c = 0; c < 3; ++c) {
+					assert(v[c] < vertex_count);
+					vertex_triangles[v[c]].emplace_back(uint32_t(t));
+					uint32_t a = v[c], b = v[(c+1)%3];
+					edge_uses[std::make_pair(std::min(a, b), std::max(a, b))] += 1;
+				}
+				glm::vec3 n = glm::cross(positions[v[1]] - positions[v[0]], positions[v[2]] - positions[v[0]]);
+				float length = glm::length(n);
+				if (length == 0.0f) continue;
+				n = n * (1.0f / length);
+				double d = -double(glm::dot(n, positions[v[0]]));
+				for (size_t c = 0; c < 3; ++c) quadrics[v[c]].add_plane(n, d, 0.5 * double(length));
+			}
+			for (auto const &edge : edge_uses) {
+				if (edge.second == 1) {
+					locked[edge.first.first] = true;
+					locked[edge.first.second] = true;
+				}
+			}
+
+			//seams: vertices that share a position with another vertex
+			std::map< std::tuple< float, float, float >, uint32_t > at_position;
+			for (size_t v = 0; v < vertex_count; ++v) {
+				auto key = std::make_tuple(positions[v].x, positions[v].y, positions[v].z);
+				auto found = at_position.find(key);
+				if (found == at_position.end()) {
+					at_position.emplace(key, uint32_t(v));
+				} else {
+					locked[v] = true;
+					locked[found->second] = true;
+				}
+			}
+
+			for (size_t v = 0; v < vertex_count; ++v) push_best(uint32_t(v));
+		}
+
+		//how much moving 'from' onto 'to' changes its bone weights, from 0 (same) to 2 (disjoint):
+		double weight_distance(uint32_t from, uint32_t to) const {
+			if (influences.empty()) return 0.0;
+			double distance = 0.0;
+			for (auto const &a : influences[from]) {
+				double other = 0.0;
+				for (auto const &b : influences[to]) if (b.bone == a.bone) other = b.weight;
+				distance += std::abs(a.weight - other);
+			}
+			for (auto const &b : influences[to]) {
+				bool shared = false;
+				for (auto const &a : influences[from]) if (a.bone == b.bone) shared = true;
+				if (!shared) distance += b.weight;
+			}
+			return distance;
+		}
+
+		//cost of collapsing 'from' onto 'to', or a negative number if the collapse isn't allowed:
+		double collapse_cost(uint32_t from, uint32_t to) const {
+			if (locked[from]) return -1.0;
+			glm::vec3 const &target = positions[to];
+			for (auto t : vertex_triangles[from]) {
+				if (dead[t]) continue;
+				uint32_t v[3] = {triangles[3*t+0], triangles[3*t+1], triangles[3*t+2]};
+				if (v[0] == to || v[1] == to || v[2] == to) continue; //this triangle collapses away
+				glm::vec3 before = glm::cross(positions[v[1]] - positions[v[0]], positions[v[2]] - positions[v[0]]);
+				glm::vec3 p[3];
+				for (size_t c = 0; c < 3; ++c) p[c] = (v[c] == from ? target : positions[v[c]]);
+				glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+				if (glm::dot(before, after) <= 0.0f) return -1.0; //would flip (or become degenerate)
+			}
+			Quadric q = quadrics[from];
+			q.add(quadrics[to]);
+			double weight_error = 0.5 * weight_distance(from, to) * weight_error_scale;
+			return q.error(target) + weight_error * weight_error;
+		}
+
+		//queue the cheapest allowed collapse of 'from' onto one of its neighbors:
+		void push_best(uint32_t from) {
+			if (locked[from] || collapsed_into[from] != from) return;
+			Candidate best;
+			best.cost = -1.0;
+			for (auto t : vertex_triangles[from]) {
+				if (dead[t]) continue;
+				for (size_t c = 0; c < 3; ++c) {
+					uint32_t to = triangles[3*t+c];
+					if (to == from) continue;
+					double cost = collapse_cost(from, to);
+					if (cost >= 0.0 && (best.cost < 0.0 || cost < best.cost)) {
+						best.cost = cost;
+						best.to = to;
+					}
+				}
+			}
+			if (best.cost < 0.0) return;
+			best.from = from;
+			best.version = version[from];
+			queue.push(best);
+		}
+
+		void collapse(uint32_t from, uint32_t to) {
+			std::vector< uint32_t > touched;
+			for (auto t : vertex_triangles[from]) {
+				if (dead[t]) continue;
+				bool has_to = false;
+				for (size_t c = 0; c < 3; ++c) {
+					if (triangles[3*t+c] == to) has_to = true;
+				}
+				if (has_to) {
+					dead[t] = true;
+					--live_triangles;
+				} else {
+					for (size_t c = 0; c < 3; ++c) {
+						if (triangles[3*t+c] == from) triangles[3*t+c] = to;
+					}
+					vertex_triangles[to].emplace_back(t);
+				}
+				for (size_t c = 0; c < 3; ++c) touched.emplace_back(triangles[3*t+c]);
+			}
+			vertex_triangles[from].clear();
+			quadrics[to].add(quadrics[from]);
+			collapsed_into[from] = to;
+			auto &around = vertex_triangles[to];
+			around.erase(std::remove_if(around.begin(), around.end(), [this](uint32_t t) { return dead[t]; }), around.end());
+
+			//neighbors' best collapses may have changed:
+			std::sort(touched.begin(), touched.end());
+			touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+			for (auto v : touched) {
+				if (v == from) continue;
+				++version[v];
+				push_best(v);
+			}
+		}
+
+		//collapse until at most 'target' triangles are left or nothing can be collapsed:
+		void simplify(size_t target) {
+			while (live_triangles > target && !queue.empty()) {
+				Candidate candidate = queue.top();
+				queue.pop();
+				if (candidate.version != version[candidate.from] || collapsed_into[candidate.from] != candidate.from) continue;
+				//the queued target may itself have been collapsed since; recompute against the current neighborhood:
+				double cost = (collapsed_into[candidate.to] == candidate.to ? collapse_cost(candidate.from, candidate.to) : -1.0);
+				if (cost < 0.0 || cost > candidate.cost * 1.0001 + 1e-12) {
+					++version[candidate.from];
+					push_best(candidate.from);
+					continue;
+				}
+				max_error = std::max(max_error, cost);
+				collapse(candidate.from, candidate.to);
+			}
+		}
+
+		std::vector< unsigned int > live_indices() const {
+			std::vector< unsigned int > ret;
+			ret.reserve(3 * live_triangles);
+			for (size_t t = 0; t < dead.size(); ++t) {
+				if (dead[t]) continue;
+				ret.insert(ret.end(), triangles.begin() + 3 * t, triangles.begin() + 3 * t + 3);
+			}
+			return ret;
+		}
+	};
+}
+
+void simplify_lods(std::vector< unsigned int > const &indices, std::vector< float > const &positions,
+	std::vector< std::vector< BoneInfluence > > const &influences, std::vector< float > const &ratios,
+	float weight_error_scale, std::vector< std::vector< unsigned int > > *lods_, std::vector< float > *errors_) {
+	assert(lods_ && errors_);
+	auto &lods = *lods_;
+	auto &errors = *errors_;
+	lods.clear();
+	errors.clear();
+	assert(influences.empty() || influences.size() == positions.size() / 3);
+
+	Simplifier simplifier(indices, positions, influences, weight_error_scale);
+	size_t base_triangles = indices.size() / 3;
+	size_t previous_triangles = base_triangles;
+	for (float ratio : ratios) {
+		size_t target = size_t(std::floor(double(ratio) * double(base_triangles)));
+		simplifier.simplify(target);
+		if (simplifier.live_triangles >= previous_triangles) break; //stuck: coarser levels would be the same
+		previous_triangles = simplifier.live_triangles;
+		lods.emplace_back(simplifier.live_indices());
+		errors.emplace_back(float(std::sqrt(simplifier.max_error)));
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "limit_influences.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+//Build a chain of simplified index buffers ("LODs") for a triangle list by collapsing edges
+// in order of quadric error (Garland & Heckbert 1997, "Surface Simplification Using Quadric Error Metrics").
+//
+// vertices are only ever collapsed onto other existing vertices, so every level shares the
+// base mesh's vertex buffer. To keep skinning and shading intact:
+// - vertices on seams (another vertex at the same position, i.e. a normal / uv split) or on open borders never move,
+// - changing a vertex's bone weights costs as much as moving it by up to weight_error_scale (for a complete change),
+// - collapses that would flip a triangle are rejected.
+//
+// positions - three floats per vertex
+// influences - bone influences per vertex (after limit_influences)
+// ratios - target fraction of the base triangle count for each level, decreasing (e.g. 0.5, 0.25, 0.1)
+// lods - receives one index buffer per level (levels that could not be reduced further are left out)
+// errors - receives each level's geometric error, in model units
+void simplify_lods(std::vector< unsigned int > const &indices, std::vector< float > const &positions,
+	std::vector< std::vector< BoneInfluence > > const &influences, std::vector< float > const &ratios,
+	float weight_error_scale, std::vector< std::vector< unsigned int > > *lods, std::vector< float > *errors);
@@ -0,0 +1,128 @@
+#include "synthetic_rig.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace {
+	aiMatrix4x4 translation(float x, float y, float z) {
+		aiMatrix4x4 ret;
+		ret.a1 = 1.0f; ret.a2 = 0.0f; ret.a3 = 0.0f; ret.a4 = x;
+		ret.b1 = 0.0f; ret.b2 = 1.0f; ret.b3 = 0.0f; ret.b4 = y;
+		ret.c1 = 0.0f; ret.c2 = 0.0f; ret.c3 = 1.0f; ret.c4 = z;
+		ret.d1 = 0.0f; ret.d2 = 0.0f; ret.d3 = 0.0f; ret.d4 = 1.0f;
+		return ret;
+	}
+
+	std::string node_name(unsigned int n) {
+		return "bone_" + std::to_string(n);
+	}
+}
+
+aiScene *make_synthetic_rig(unsigned int node_count, unsigned int frame_count) {
+	if (node_count == 0) node_count = 1;
+	if (frame_count == 0) frame_count = 1;
+
+	aiScene *scene = new aiScene();
+
+	//hierarchy: node n has children 2n+1 and 2n+2
+	std::vector< aiNode * > nodes(node_count);
+	for (unsigned int n = 0; n < node_count; ++n) {
+		nodes[n] = new aiNode();
+		nodes[n]->mName.Set(node_name(n));
+		nodes[n]->mTransformation = translation(0.0f, 0.1f, (n % 2 ? 0.05f : -0.05f));
+	}
+	for (unsigned int n = 0; n < node_count; ++n) {
+		unsigned int first = 2 * n + 1;
+		unsigned int count = (first >= node_count ? 0 : std::min(2u, node_count - first));
+		nodes[n]->mNumChildren = count;
+		nodes[n]->mChildren = (count ? new aiNode *[count] : nullptr);
+		for (unsigned int c = 0; c < count; ++c) {
+			nodes[n]->mChildren[c] = nodes[first + c];
+			nodes[first + c]->mParent = nodes[n];
+		}
+	}
+	scene->mRootNode = nodes[0];
+
+	//mesh: a quad (4 vertices, 2 triangles) per bone, each vertex weighted to its bone and up to three ancestors
+	aiMesh *mesh = new aiMesh();
+	mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+	mesh->mNumVertices = 4 * node_count;
+	mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+	mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+	for (unsigned int v = 0; v < mesh->mNumVertices; ++v) {
+		float x = float(v % 2);
+		float y = float(v / 2);
+		mesh->mVertices[v] = aiVector3D{x * 0.1f, y * 0.05f, 0.0f};
+		mesh->mNormals[v] = aiVector3D{0.0f, 0.0f, 1.0f};
+	}
+	mesh->mNumFaces = 2 * node_count;
+	mesh->mFaces = new aiFace[mesh->mNumFaces];
+	for (unsigned int n = 0; n < node_count; ++n) {
+		unsigned int quad[2][3] = {{4*n+0, 4*n+1, 4*n+2}, {4*n+2, 4*n+1, 4*n+3}};
+		for (unsigned int t = 0; t < 2; ++t) {
+			aiFace &face = mesh->mFaces[2*n+t];
+			face.mNumIndices = 3;
+			face.mIndices = new unsigned int[3];
+			for (unsigned int c = 0; c < 3; ++c) face.mIndices[c] = quad[t][c];
+		}
+	}
+
+	//the quad of node n is weighted to n and its three nearest ancestors (0.4, 0.3, 0.2, 0.1):
+	std::vector< std::vector< aiVertexWeight > > weights(node_count);
+	for (unsigned int n = 0; n < node_count; ++n) {
+		unsigned int bone = n;
+		float weight[4] = {0.4f, 0.3f, 0.2f, 0.1f};
+		for (unsigned int i = 0; i < 4; ++i) {
+			for (unsigned int v = 0; v < 4; ++v) {
+				weights[bone].push_back(aiVertexWeight{4*n+v, weight[i]});
+			}
+			if (bone == 0) break;
+			bone = (bone - 1) / 2;
+		}
+	}
+	mesh->mNumBones = node_count;
+	mesh->mBones = new aiBone *[node_count];
+	for (unsigned int n = 0; n < node_count; ++n) {
+		aiBone *bone = new aiBone();
+		bone->mName.Set(node_name(n));
+		bone->mOffsetMatrix = translation(0.0f, -0.1f, 0.0f);
+		bone->mNumWeights = unsigned(weights[n].size());
+		bone->mWeights = new aiVertexWeight[bone->mNumWeights];
+		for (unsigned int w = 0; w < bone->mNumWeights; ++w) bone->mWeights[w] = weights[n][w];
+		mesh->mBones[n] = bone;
+	}
+	scene->mNumMeshes = 1;
+	scene->mMeshes = new aiMesh *[1];
+	scene->mMeshes[0] = mesh;
+
+	//animation: every node sways a little around its own axis
+	aiAnimation *animation = new aiAnimation();
+	animation->mName.Set("sway");
+	animation->mDuration = double(frame_count - 1);
+	animation->mTicksPerSecond = 30.0;
+	animation->mNumChannels = node_count;
+	animation->mChannels = new aiNodeAnim *[node_count];
+	for (unsigned int n = 0; n < node_count; ++n) {
+		aiNodeAnim *channel = new aiNodeAnim();
+		channel->mNodeName.Set(node_name(n));
+		channel->mNumPositionKeys = channel->mNumRotationKeys = channel->mNumScalingKeys = frame_count;
+		channel->mPositionKeys = new aiVectorKey[frame_count];
+		channel->mRotationKeys = new aiQuatKey[frame_count];
+		channel->mScalingKeys = new aiVectorKey[frame_count];
+		for (unsigned int f = 0; f < frame_count; ++f) {
+			float angle = 0.2f * std::sin(0.1f * float(f) + 0.01f * float(n));
+			channel->mPositionKeys[f].mTime = channel->mRotationKeys[f].mTime = channel->mScalingKeys[f].mTime = double(f);
+			channel->mPositionKeys[f].mValue = aiVector3D{0.0f, 0.1f, (n % 2 ? 0.05f : -0.05f)};
+			channel->mRotationKeys[f].mValue = aiQuaternion{std::cos(0.5f * angle), 0.0f, 0.0f, std::sin(0.5f * angle)};
+			channel->mScalingKeys[f].mValue = aiVector3D{1.0f, 1.0f, 1.0f};
+		}
+		animation->mChannels[n] = channel;
+	}
+	scene->mNumAnimations = 1;
+	scene->mAnimations = new aiAnimation *[1];
+	scene->mAnimations[0] = animation;
+
+	return scene;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <assimp/scene.h>
+
+//Build an in-memory scene shaped like a (very) large character, for benchmarking the exporter:
+// - 'node_count' nodes in a balanced binary tree, with unique names
+// - one skinned mesh with a bone per node (a small quad strip per bone, four influences per vertex)
+// - one animation with a channel per node, 'frame_count' keys each
+//
+// the scene is allocated the way Assimp's importers allocate, so 'delete' frees all of it.
+aiScene *make_synthetic_rig(unsigned int node_count, unsigned int frame_count);